@@ -0,0 +1,114 @@
+// Query latency of the unstructured surface backend.
+//
+// Usage: point_cloud_surface_benchmark [points] [queries]
+//
+// Builds a cloud of randomly scattered points on a wavy 0.5 m x 0.5 m surface
+// and times single queries, as computeStiffness() issues them.
+
+#include <cartesian_adaptive_compliance_controller/point_cloud_surface.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace cartesian_adaptive_compliance_controller;
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char ** argv)
+{
+  const size_t point_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  const size_t query_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> position(0.0, 0.5);
+  auto height = [](double x, double y) { return 0.1 + 0.01 * std::sin(20 * x) * std::cos(15 * y); };
+
+  std::vector<SurfacePoint> points(point_count);
+  for (SurfacePoint & p : points)
+  {
+    p.x = position(random);
+    p.y = position(random);
+    p.z = height(p.x, p.y);
+    p.stiffness = 500.0 + 100.0 * p.x;
+    p.damping = 20.0;
+  }
+
+  PointCloudSurface cloud;
+  std::string error;
+  auto start = Clock::now();
+  if (!cloud.build(std::move(points), 4.0, error))
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  const double build_time = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // Queries off the scanned area must not find a surface
+  const double outside_queries[][2] = {{5.0, 5.0}, {-1.0, 0.25}, {0.25, 0.6}};
+  SurfaceSample outside;
+  for (const auto & q : outside_queries)
+  {
+    if (cloud.sample(q[0], q[1], outside))
+    {
+      std::cerr << "query at (" << q[0] << ", " << q[1] << ") outside the cloud found a surface"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // Random positions show the cache-cold worst case. A continuous path
+  // advancing 0.1 mm per query resembles what the control loop does.
+  auto run = [&](const char * name, auto next_position) {
+    std::vector<double> latencies(query_count);
+    SurfaceSample sample;
+    double max_error = 0.0;
+    for (size_t i = 0; i < query_count; ++i)
+    {
+      double x, y;
+      next_position(i, x, y);
+      auto t0 = Clock::now();
+      cloud.sample(x, y, sample);
+      auto t1 = Clock::now();
+      latencies[i] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+      max_error = std::max(max_error, std::abs(sample.z - height(x, y)));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+      return latencies[static_cast<size_t>(p * (query_count - 1))];
+    };
+    double mean = 0.0;
+    for (double l : latencies)
+    {
+      mean += l / query_count;
+    }
+    std::cout << name << " queries:\n"
+              << "  mean:        " << mean << " ns\n"
+              << "  p50:         " << percentile(0.5) << " ns\n"
+              << "  p99:         " << percentile(0.99) << " ns\n"
+              << "  p99.9:       " << percentile(0.999) << " ns\n"
+              << "  max:         " << latencies.back() << " ns\n"
+              << "  max z error: " << max_error << " m" << std::endl;
+  };
+
+  std::cout << "points:        " << cloud.size() << " (" << cloud.droppedPoints()
+            << " dropped)\n"
+            << "build:         " << build_time << " s\n"
+            << "queries:       " << query_count << std::endl;
+
+  run("random", [&](size_t, double & x, double & y) {
+    x = position(random);
+    y = position(random);
+  });
+  run("path", [&](size_t i, double & x, double & y) {
+    const double s = 1e-4 * i;
+    x = 0.25 + 0.2 * std::sin(s);
+    y = 0.25 + 0.2 * std::sin(1.3 * s);
+  });
+  return 0;
+}
@@ -9,9 +9,28 @@
 #include <kdl/chain.hpp>
 #include <kdl/chainfksolvervel_recursive.hpp>
 #include <cartesian_adaptive_compliance_controller/qpOASES.hpp>
-#include <cartesian_adaptive_compliance_controller/data_reader.h>
+#include <cartesian_adaptive_compliance_controller/flight_recorder.h>
+#include <cartesian_adaptive_compliance_controller/latency_monitor.h>
+#include <cartesian_adaptive_compliance_controller/perf_counters.h>
+#include <cartesian_adaptive_compliance_controller/period_monitor.h>
+#include <cartesian_adaptive_compliance_controller/material_volume.h>
+#include <cartesian_adaptive_compliance_controller/msg/adaptive_stiffness_state.hpp>
+#include <cartesian_adaptive_compliance_controller/realtime_loaned_publisher.h>
+#include <cartesian_adaptive_compliance_controller/realtime_logger.h>
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_learner.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_loader.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_sequence.h>
+#include <cartesian_adaptive_compliance_controller/telemetry.h>
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_MATLOGGER2
+#include <cartesian_adaptive_compliance_controller/telemetry_mat_logger.h>
+#endif
+#include <Eigen/Geometry>
+#include <realtime_tools/realtime_buffer.h>
+#include <realtime_tools/realtime_publisher.h>
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "std_msgs/msg/float64_multi_array.hpp"
-#include <queue>
+#include "std_msgs/msg/string.hpp"
 
 USING_NAMESPACE_QPOASES
 namespace cartesian_adaptive_compliance_controller
@@ -98,32 +117,95 @@ class CartesianAdaptiveComplianceController
     double d_pass_damp_int, en_var_stiff_int;
     double energy_var_stiff, energy_var_damping;
     rclcpp::Time old_time,current_time,start_time;
-    double old_z;
-    std::queue<double> m_surf_vel;
-    double m_surf_vel_sum;
+    rclcpp::Duration m_minimum_update_interval{0, 0};
 
     QProblem min_problem;
     int print_index = 0;
 
+    // messages of the control loop, formatted and printed in the background
+    RealtimeLogger m_realtime_logger;
+
     // ft sensor subscriber
     rclcpp::Subscription<geometry_msgs::msg::WrenchStamped>::SharedPtr m_ft_sensor_wrench_subscriber;
     void ftSensorWrenchCallback(const geometry_msgs::msg::WrenchStamped::SharedPtr wrench);
     ctrl::Vector3D m_ft_sensor_wrench;
 
-    // data publisher
-    rclcpp::Publisher<std_msgs::msg::Float64MultiArray>::SharedPtr  m_data_publisher;
+    // state publisher, filled in place by the control loop and published from
+    // its own thread
+    rclcpp::Publisher<msg::AdaptiveStiffnessState>::SharedPtr  m_state_publisher;
+    std::unique_ptr<RealtimeLoanedPublisher<msg::AdaptiveStiffnessState>>
+      m_realtime_state_publisher;
+
+    // deprecated positional form of the state on /adaptive_stiffness_data,
+    // kept for one release
+    std::unique_ptr<realtime_tools::RealtimePublisher<std_msgs::msg::Float64MultiArray>>
+      m_legacy_data_publisher;
+    void publishLegacyData();
+
+    // telemetry of the current cycle, and the decimated fields not yet published
+    TelemetrySample m_telemetry;
+    uint64_t m_telemetry_cycle;
+    uint64_t m_telemetry_pending;
+    void publishTelemetry();
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_MATLOGGER2
+    TelemetryMatLogger m_mat_logger;
+#endif
+
+    // last seconds of telemetry, saved when a fault occurs
+    FlightRecorder m_flight_recorder;
+    double m_cycle_deadline;
+
+    //! Rate of the controller manager, or 1 kHz if the distribution does not tell
+    double nominalUpdateRate() const;
+
+    // latency of the phases of update(), and period and load of the loop,
+    // published as diagnostics
+    LatencyMonitor m_latency;
+    PeriodMonitor m_period_monitor;
+    PeriodSummary m_period_summary;
+    std::chrono::steady_clock::time_point m_last_update;  // Foxy passes no period
+
+    // hardware events in the stiffness computation, opt-in
+    PerfCounters m_perf_counters;
+    std::array<PerfSummary, kPerfSections> m_perf_summaries;
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr m_diagnostics_publisher;
+    rclcpp::TimerBase::SharedPtr m_diagnostics_timer;
+    std::array<LatencySummary, kLatencyPhases> m_latency_summaries;
+    void publishDiagnostics();
+
+    // cycles computed since the activation, to match up tracepoints
+    uint64_t m_cycle;
+
     rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr  m_target_pose_publisher;
     void publishTargetFrame();
     int step_seconds = 20;
     double z_step = 0.05;
     ctrl::Vector3D m_starting_pose;
 
-    // data from the data reader
-    std::vector<double> m_x_coordinates;
-    std::vector<double> m_y_coordinates;
-    std::vector<std::vector<double>> m_z_values;
-    std::vector<std::vector<double>> m_stiffness_values;
-    std::vector<std::vector<double>> m_damping_values;
+    // surface map, swapped in by the loader at runtime, or streamed frames
+    // of a time-varying surface
+    SurfaceMapLoader m_map_loader;
+    SurfaceMapSequence m_map_sequence;
+    SurfaceFrames m_surface_frames;
+    SurfaceSample m_surface_sample;
+    SurfaceCursor m_surface_cursor;
+
+    // stiffness and damping learned online from the contact forces
+    SurfaceMapLearner m_map_learner;
+
+    // pose of the robot base in the frame of the surface map, looked up once
+    // and replaced by messages on ~/surface_map_pose
+    realtime_tools::RealtimeBuffer<Eigen::Isometry3d> m_base_to_map;
+    rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr m_surface_map_pose_subscriber;
+    void surfaceMapPoseCallback(const geometry_msgs::msg::PoseStamped::SharedPtr pose);
+    bool lookupSurfaceMapFrame(const std::string & frame, std::string & error);
+
+    // contact prediction from the signed distance field
+    double m_contact_prediction_horizon;
+    double m_surface_distance;
+    double m_time_to_contact;
+    rclcpp::Subscription<std_msgs::msg::String>::SharedPtr m_surface_map_subscriber;
+    void surfaceMapCallback(const std_msgs::msg::String::SharedPtr directory);
 
 
 };
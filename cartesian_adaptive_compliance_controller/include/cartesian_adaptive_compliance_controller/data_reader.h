@@ -1,81 +1,90 @@
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <sstream>
+#ifndef DATA_READER_H_INCLUDED
+#define DATA_READER_H_INCLUDED
 
-void  dataReader( std::vector<double>& x_coordinates, std::vector<double>& y_coordinates, std::vector<std::vector<double>>& z_values, std::vector<std::vector<double>>& stiffness_values, std::vector<std::vector<double>>& damping_values){
-    std::string directory = "/home/robotics/ur3_ros2/matlab/data_body/";
-    std::string x_filename = directory + "x.txt";
-    std::string y_filename = directory + "y.txt";
-    std::string z_filename = directory + "z.txt";
-    std::string stiffness_filename = directory + "stiffness.txt";
-    std::string damping_filename = directory + "damping.txt";
+#include <cstddef>
+#include <string>
+#include <vector>
 
-    // Read x coordinates from the first file
-    std::ifstream x_file(x_filename);
-    double x_value;
-    while (x_file >> x_value) {
-        x_coordinates.push_back(x_value);
-    }
-    x_file.close();
+namespace cartesian_adaptive_compliance_controller
+{
 
-    // Read y coordinates from the second file
-    std::ifstream y_file(y_filename);
-    double y_value;
-    while (y_file >> y_value) {
-        y_coordinates.push_back(y_value);
-    }
-    y_file.close();
+/**
+ * @brief Statistics of reading one text file
+ */
+struct DataReaderTiming
+{
+  std::string filename;
+  size_t bytes = 0;
+  size_t values = 0;
+  double seconds = 0.0;
+};
 
-    // Determine the dimensions (n and m) based on the sizes of x and y vectors
-    int n = x_coordinates.size();
-    int m = y_coordinates.size();
+/**
+ * @brief Read the MATLAB text files of a surface map
+ *
+ * The five files are memory-mapped and parsed concurrently. Large files are
+ * split into chunks of whole lines that worker threads parse with
+ * std::from_chars, independent of the locale.
+ *
+ * Grid fields come back row-major with one row per x coordinate, as they
+ * are in the files. A field must hold exactly one value per grid cell. If
+ * its file has one line per x coordinate, every line must hold one value
+ * per y coordinate.
+ *
+ * @param timings Per-file statistics in the order x, y, z, stiffness, damping
+ *
+ * @return True if all files could be read and their dimensions match
+ */
+bool dataReader(const std::string & directory, std::vector<double> & x_coordinates,
+                std::vector<double> & y_coordinates, std::vector<double> & z_values,
+                std::vector<double> & stiffness_values, std::vector<double> & damping_values,
+                std::vector<DataReaderTiming> & timings, std::string & error);
 
-    // Read z values from the third file and store them in a 2D vector
-    std::ifstream z_file(z_filename);
-    z_values.resize(n, std::vector<double>(m));
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            z_file >> z_values[i][j];
-            z_values[i][j] += 0.0015;
-        }
-    }
-    z_file.close();
+//! Numbers per line of a material table
+constexpr size_t kMaterialFields = 6;
 
-    // Read stiffness values from the fourth file and store them in a 2D vector
-    std::ifstream stiffness_file(stiffness_filename);
-    stiffness_values.resize(n, std::vector<double>(m));
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            stiffness_file >> stiffness_values[i][j];
-        }
-    }
-    stiffness_file.close();
+/**
+ * @brief Read the text files of a surface map with material IDs
+ *
+ * Like dataReader(), but `material.txt` holds a material ID per cell in place
+ * of the stiffness and damping files. `materials.txt` has one
+ * `id stiffness damping exponent max_penetration min_force` line per
+ * material.
+ *
+ * @param materials All numbers of the material table in file order
+ * @param timings Per-file statistics in the order x, y, z, material, materials
+ */
+bool materialMapReader(const std::string & directory, std::vector<double> & x_coordinates,
+                       std::vector<double> & y_coordinates, std::vector<double> & z_values,
+                       std::vector<double> & material_ids, std::vector<double> & materials,
+                       std::vector<DataReaderTiming> & timings, std::string & error);
 
-    // Read damping values from the fifth file and store them in a 2D vector
-    std::ifstream damping_file(damping_filename);
-    damping_values.resize(n, std::vector<double>(m));
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            damping_file >> damping_values[i][j];
-        }
-    }
-    damping_file.close();
+/**
+ * @brief Read a point cloud with one `x y z stiffness damping` line per point
+ *
+ * @param values All numbers in file order
+ */
+bool pointCloudReader(const std::string & filename, std::vector<double> & values,
+                      DataReaderTiming & timing, std::string & error);
 
-    // Now you have x_coordinates, y_coordinates, z_values, stiffness_values, and damping_values
-}
+/**
+ * @brief Read a volume of stiffness and damping values against penetration depth
+ *
+ * The file starts with `nx ny nz x0 y0 depth0 dx dy ddepth`, the size,
+ * origin and spacing of the voxel grid. One `stiffness damping` pair per
+ * voxel follows, x-major with depth varying fastest.
+ *
+ * @param header The nine header values
+ * @param values The stiffness and damping pairs
+ */
+bool volumeReader(const std::string & filename, std::vector<double> & header,
+                  std::vector<double> & values, DataReaderTiming & timing, std::string & error);
 
-int findClosestIndex(const std::vector<double>& vec, double target) {
-    int index = 0;
-    double minDistance = std::abs(vec[0] - target);
+/**
+ * @brief One line per file: name, size, value count and parse time
+ */
+std::string formatTimings(const std::vector<DataReaderTiming> & timings);
 
-    for (long unsigned int i = 1; i < vec.size(); ++i) {
-        double distance = std::abs(vec[i] - target);
-        if (distance < minDistance) {
-            minDistance = distance;
-            index = i;
-        }
-    }
+}  // namespace cartesian_adaptive_compliance_controller
 
-    return index;
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,125 @@
+#ifndef FLIGHT_RECORDER_H_INCLUDED
+#define FLIGHT_RECORDER_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/telemetry.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+//! What makes the flight recorder dump its samples
+enum class Fault : uint8_t
+{
+  QpError,
+  EmptyTank,
+  DeadlineOverrun,
+  NonFiniteStiffness,
+  LateCycle
+};
+
+//! Name of \a fault in file names
+const char * faultName(Fault fault);
+
+/**
+ * @brief Keeps the telemetry of the last cycles in memory and saves it on faults
+ *
+ * The real-time thread records every sample into a ring that is allocated
+ * when recording starts. A fault keeps the recording going for another
+ * kPostTriggerShare of the ring, so that the dump shows what led to the
+ * fault and what followed. Then the real-time thread stops writing, a
+ * background thread copies the ring and lets it continue, and writes the
+ * copy as a CSV file of the telemetry fields, after a comment line with the
+ * fault and its time. Samples during the copy are not recorded.
+ *
+ * After a dump, faults are ignored until the ring has been filled with new
+ * samples, so that a persisting fault does not save the same cycles twice.
+ */
+class FlightRecorder
+{
+  public:
+    //! Share of the ring recorded after the fault
+    static constexpr double kPostTriggerShare = 0.2;
+
+    FlightRecorder();
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder & operator=(const FlightRecorder &) = delete;
+
+    /**
+     * @brief Start recording, discarding earlier samples
+     *
+     * Not while the real-time thread records.
+     *
+     * @param directory Existing directory for the dumps
+     * @param samples Capacity of the ring, rounded up to a power of two
+     */
+    bool start(const std::string & directory, size_t samples, std::string & error);
+
+    //! Stop recording. A dump in progress is finished first.
+    void stop();
+
+    bool isRunning() const { return m_worker.joinable(); }
+
+    //! Real-time safe. Does nothing unless running.
+    void record(const TelemetrySample & sample);
+
+    //! Real-time safe. Dump the ring, unless a dump is pending or held off.
+    void trigger(Fault fault);
+
+    //! Number of dumps written
+    uint64_t dumps() const { return m_dumps.load(); }
+
+    //! File of the last dump
+    std::string lastDump() const;
+
+    std::string lastError() const;
+
+  private:
+    enum State
+    {
+      Recording,
+      Triggered,
+      Frozen
+    };
+
+    void workerLoop();
+    void dump(Fault fault, double time);
+
+    // Constant while running
+    std::string m_directory;
+    std::vector<TelemetrySample> m_ring;
+    size_t m_mask;
+
+    // Owned by the worker
+    std::vector<TelemetrySample> m_snapshot;
+    uint64_t m_sequence;
+
+    // Owned by the real-time thread, and by the worker while frozen
+    uint64_t m_count;
+    uint64_t m_stop_at;
+    uint64_t m_armed_at;
+    Fault m_fault;
+    double m_fault_time;
+
+    std::atomic<int> m_state;
+    std::atomic<uint64_t> m_dumps;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+    std::string m_last_dump;
+    std::string m_last_error;
+    bool m_stop;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
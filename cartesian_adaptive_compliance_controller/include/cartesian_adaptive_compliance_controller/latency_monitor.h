@@ -0,0 +1,151 @@
+#ifndef LATENCY_MONITOR_H_INCLUDED
+#define LATENCY_MONITOR_H_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Histogram of durations in nanoseconds with constant relative precision
+ *
+ * Buckets are linear up to 2 * kSubBuckets ns and then split every power of
+ * two into kSubBuckets, so any value is off by at most 1 / kSubBuckets,
+ * about 3 %, like an HDR histogram with two significant digits. Values from
+ * 4.3 s on count as 4.3 s.
+ *
+ * One thread records without locks or allocation. Another takes windows of
+ * what was recorded since its last window, which leaves the counts alone.
+ */
+class LatencyHistogram
+{
+  public:
+    static constexpr unsigned kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBucketBits;
+    static constexpr uint64_t kMaxValue = (uint64_t(1) << 32) - 1;
+    static constexpr size_t kBuckets = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+    //! Real-time safe. For one recording thread.
+    void record(uint64_t nanoseconds)
+    {
+      std::atomic<uint64_t> & count = m_counts[bucket(nanoseconds)];
+      count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    //! Counts per bucket since the last call
+    void takeWindow(std::vector<uint64_t> & window);
+
+    //! Smallest value that \a quantile of \a window do not exceed
+    static uint64_t quantile(const std::vector<uint64_t> & window, double quantile);
+
+    static size_t bucket(uint64_t value);
+
+    //! Largest value counted in \a bucket
+    static uint64_t bucketLimit(size_t bucket);
+
+  private:
+    std::array<std::atomic<uint64_t>, kBuckets> m_counts{};
+    std::vector<uint64_t> m_taken;
+};
+
+//! Stages of a control cycle
+enum class LatencyPhase : size_t
+{
+  Synchronize,
+  EndEffectorPose,
+  MapLookup,
+  QpSolve,
+  ComplianceIterations,
+  WriteCommands,
+  Count
+};
+
+constexpr size_t kLatencyPhases = static_cast<size_t>(LatencyPhase::Count);
+
+const char * latencyPhaseName(LatencyPhase phase);
+
+//! Durations of one phase within a window, in nanoseconds
+struct LatencySummary
+{
+  uint64_t samples = 0;
+  uint64_t p50 = 0;
+  uint64_t p99 = 0;
+  uint64_t p999 = 0;
+  uint64_t max = 0;
+};
+
+/**
+ * @brief Times the phases of the control cycle into one histogram each
+ *
+ * Timestamps are read from the time stamp counter where it runs at a
+ * constant rate across cores and sleep states, which takes a few
+ * nanoseconds, and from std::chrono::steady_clock otherwise. The counter
+ * is calibrated against the steady clock.
+ */
+class LatencyMonitor
+{
+  public:
+    LatencyMonitor();
+
+    /**
+     * @brief Choose the clock and measure the counter frequency
+     *
+     * Takes about 20 ms. Not while the real-time thread records.
+     */
+    void calibrate();
+
+    bool usesTsc() const { return m_tsc; }
+
+    //! Real-time safe. A timestamp in ticks.
+    uint64_t now() const
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      if (m_tsc)
+      {
+        // Keeps the counter from being read before earlier instructions finish
+        _mm_lfence();
+        return __rdtsc();
+      }
+#endif
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    }
+
+    /**
+     * @brief Record the time from \a start until now for \a phase
+     *
+     * Real-time safe. For one recording thread.
+     *
+     * @return Now, to start the next phase with
+     */
+    uint64_t record(LatencyPhase phase, uint64_t start)
+    {
+      const uint64_t end = now();
+      m_histograms[static_cast<size_t>(phase)].record(
+        static_cast<uint64_t>((end - start) * m_nanoseconds_per_tick));
+      return end;
+    }
+
+    //! What each phase recorded since the last call. Not real-time safe.
+    void summarize(std::array<LatencySummary, kLatencyPhases> & summaries);
+
+  private:
+    bool m_tsc;
+    double m_nanoseconds_per_tick;
+    std::array<LatencyHistogram, kLatencyPhases> m_histograms;
+    std::vector<uint64_t> m_window;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
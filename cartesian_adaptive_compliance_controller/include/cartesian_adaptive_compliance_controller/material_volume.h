@@ -0,0 +1,107 @@
+#ifndef MATERIAL_VOLUME_H_INCLUDED
+#define MATERIAL_VOLUME_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+//! File next to a surface map that holds its material volume
+constexpr const char * kMaterialVolumeName = "stiffness_volume.txt";
+
+/**
+ * @brief Stiffness and damping of the material against penetration depth
+ *
+ * A regular grid over x, y and the depth below the surface. The values are
+ * secant coefficients: at depth d the contact force is
+ * `stiffness(d) * d - damping(d) * d * v`, so any force-depth curve can be
+ * tabulated, e.g. `k * pow(d, 0.35)` for the power law of the 2-D maps.
+ *
+ * Voxels are grouped into bricks of kBrickSize^3. Bricks in which all voxels
+ * are equal, which is most of them in layered material, are stored once as a
+ * single value.
+ */
+class MaterialVolume
+{
+  public:
+    static constexpr size_t kBrickSize = 8;
+
+    struct Voxel
+    {
+      float stiffness;
+      float damping;
+
+      bool operator==(const Voxel & other) const
+      {
+        return stiffness == other.stiffness && damping == other.damping;
+      }
+    };
+
+    /**
+     * @brief Build the volume from the contents of a volume file
+     *
+     * @param header `nx ny nz x0 y0 depth0 dx dy ddepth` as read by volumeReader()
+     * @param values One stiffness and damping pair per voxel, x-major with depth varying fastest
+     */
+    bool build(const std::vector<double> & header, const std::vector<double> & values,
+               std::string & error);
+
+    bool empty() const { return m_brick_index.empty(); }
+
+    /**
+     * @brief Trilinear lookup at (\a x, \a y) and \a depth below the surface
+     *
+     * O(1), allocation-free and real-time safe. The depth is clamped onto the
+     * grid.
+     *
+     * @return False if (\a x, \a y) is outside the grid
+     */
+    bool sample(double x, double y, double depth, double & stiffness, double & damping) const;
+
+    //! Bytes held by the compressed volume
+    size_t memorySize() const;
+
+    //! Size, coverage and compression, for the load report
+    std::string describe() const;
+
+  private:
+    const Voxel & voxel(size_t i, size_t j, size_t k) const
+    {
+      const int32_t brick =
+        m_brick_index[((i / kBrickSize) * m_bricks[1] + j / kBrickSize) * m_bricks[2] +
+                      k / kBrickSize];
+      if (brick < 0)
+      {
+        return m_uniform[-1 - brick];
+      }
+      return m_voxels[(static_cast<size_t>(brick) * kBrickSize + i % kBrickSize) * kBrickSize *
+                        kBrickSize +
+                      (j % kBrickSize) * kBrickSize + k % kBrickSize];
+    }
+
+    size_t m_size[3] = {0, 0, 0};
+    double m_origin[3] = {0.0, 0.0, 0.0};
+    double m_spacing[3] = {0.0, 0.0, 0.0};
+    size_t m_bricks[3] = {0, 0, 0};
+
+    // Per brick, an index into the stored bricks or, if negative, -1 - index
+    // into the uniform values
+    std::vector<int32_t> m_brick_index;
+    std::vector<Voxel> m_voxels;
+    std::vector<Voxel> m_uniform;
+};
+
+/**
+ * @brief Read a material volume file
+ *
+ * @param report Appended with the parse time and compression
+ */
+bool readMaterialVolume(const std::string & filename, MaterialVolume & volume,
+                        std::string & report, std::string & error);
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
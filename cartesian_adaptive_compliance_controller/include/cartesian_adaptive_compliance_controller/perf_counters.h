@@ -0,0 +1,159 @@
+#ifndef PERF_COUNTERS_H_INCLUDED
+#define PERF_COUNTERS_H_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+//! Code measured with the performance counters
+enum class PerfSection : size_t
+{
+  ComputeStiffness,
+  MapLookup,
+  Count
+};
+
+constexpr size_t kPerfSections = static_cast<size_t>(PerfSection::Count);
+
+const char * perfSectionName(PerfSection section);
+
+//! Hardware events counted in each section
+enum class PerfEvent : size_t
+{
+  Cycles,
+  Instructions,
+  L1dReadMisses,
+  LlcMisses,
+  BranchMisses,
+  Count
+};
+
+constexpr size_t kPerfEvents = static_cast<size_t>(PerfEvent::Count);
+
+const char * perfEventName(PerfEvent event);
+
+//! Counts of one section within a window
+struct PerfSummary
+{
+  //! Runs of the section while the counters were scheduled on the CPU
+  uint64_t samples = 0;
+
+  //! Mean count per run, NaN where the CPU does not have the event
+  std::array<double, kPerfEvents> per_sample;
+};
+
+/**
+ * @brief Counts hardware events in sections of the real-time thread
+ *
+ * The events are opened with perf_event_open as one group, for the
+ * real-time thread only and in user space only, which works for
+ * perf_event_paranoid up to 2. Events that the CPU or the hypervisor does
+ * not provide are left out.
+ *
+ * The real-time thread does not open the counters itself. It tells its
+ * thread id on its first section after start(), and open() opens the
+ * counters for it from another thread. Once they are open, every begin()
+ * and end() reads the group with one read() system call, which takes on
+ * the order of a microsecond, so this is for measurements, not for
+ * production.
+ *
+ * The counts are accumulated per section like the latency histograms and
+ * summarized per window by the thread that opened them.
+ */
+class PerfCounters
+{
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    //! Count in the thread of the next section. Not while it runs.
+    void start();
+
+    //! Close the counters. Not while the real-time thread runs.
+    void stop();
+
+    bool isStarted() const;
+
+    //! Real-time safe, apart from a system call to get the thread id once
+    void begin(PerfSection section);
+
+    //! Real-time safe, for a section begun before
+    void end(PerfSection section);
+
+    /**
+     * @brief Open the counters once the real-time thread is known
+     *
+     * Not from the real-time thread. From the same thread as summarize().
+     *
+     * @return False if they failed to open, now or on an earlier call since
+     * start(), with the same \a error
+     */
+    bool open(std::string & error);
+
+    //! Whether opening failed since start()
+    bool hasFailed() const;
+
+    //! What each section counted since the last call
+    void summarize(std::array<PerfSummary, kPerfSections> & summaries);
+
+  private:
+    enum State
+    {
+      Stopped,
+      Started,
+      Registered,
+      Open,
+      Failed
+    };
+
+    // Values of a group read, in the order of m_events
+    struct Reading
+    {
+      uint64_t count;
+      uint64_t time_running;
+      uint64_t values[kPerfEvents];
+    };
+
+    // Whether to read the counters, registering the calling thread when it
+    // is not known yet
+    bool ready();
+
+    bool readGroup(Reading & reading);
+    void close();
+
+    std::atomic<int> m_state;
+    pid_t m_thread;
+
+    // Constant while open. The leader is the first descriptor.
+    int m_fds[kPerfEvents];
+    size_t m_count;
+    PerfEvent m_events[kPerfEvents];
+
+    // Owned by the real-time thread
+    Reading m_begin[kPerfSections];
+    Reading m_end;
+
+    // Written by the real-time thread only
+    std::atomic<uint64_t> m_samples[kPerfSections];
+    std::atomic<uint64_t> m_totals[kPerfSections][kPerfEvents];
+
+    // Owned by the thread that opens and summarizes
+    bool m_supported[kPerfEvents];
+    std::string m_error;
+    uint64_t m_seen_samples[kPerfSections];
+    uint64_t m_seen_totals[kPerfSections][kPerfEvents];
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PERIOD_MONITOR_H_INCLUDED
+#define PERIOD_MONITOR_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/latency_monitor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+//! What the control loop did within a window, durations in nanoseconds
+struct PeriodSummary
+{
+  uint64_t nominal_period = 0;
+  uint64_t deadline = 0;
+
+  //! Calls of update(), and those that returned without computing
+  uint64_t updates = 0;
+  uint64_t skipped = 0;
+
+  //! Periods beyond the tolerance, and computations beyond the deadline
+  uint64_t late = 0;
+  uint64_t overruns = 0;
+
+  uint64_t period_p50 = 0;
+  uint64_t period_p999 = 0;
+  uint64_t period_max = 0;
+
+  //! Deviation of the period from the nominal one, either way
+  uint64_t jitter_p999 = 0;
+  uint64_t jitter_max = 0;
+
+  uint64_t compute_p50 = 0;
+  uint64_t compute_p999 = 0;
+  uint64_t compute_max = 0;
+
+  //! Share of the nominal period spent computing
+  double load_p999 = 0.0;
+  double load_max = 0.0;
+};
+
+/**
+ * @brief Watches the period of the control loop and the time it computes
+ *
+ * The real-time thread reports the period of every call of update(), the
+ * calls it skipped, and the compute time of the others. Periods longer
+ * than the nominal one by more than the tolerance count as late, compute
+ * times beyond the deadline as overruns. Both are returned to the caller,
+ * so that it can treat them as faults.
+ *
+ * Like LatencyMonitor, the durations go into histograms that another
+ * thread summarizes per window.
+ */
+class PeriodMonitor
+{
+  public:
+    PeriodMonitor();
+
+    /**
+     * @brief Start over with new limits, discarding what was recorded
+     *
+     * Not while the real-time thread records or another thread summarizes.
+     *
+     * @param nominal_period Period of the controller manager, in seconds
+     * @param tolerance Share of the nominal period a period may exceed it by
+     * @param deadline Longest compute time, in seconds
+     */
+    void configure(double nominal_period, double tolerance, double deadline);
+
+    /**
+     * @brief Record the time since the previous call of update()
+     *
+     * Real-time safe. The first period after configure() is ignored, as it
+     * may include the activation.
+     *
+     * @return Whether the period was late
+     */
+    bool recordPeriod(int64_t nanoseconds);
+
+    //! Real-time safe. For a call of update() that did not compute.
+    void recordSkip() { increment(m_skipped); }
+
+    /**
+     * @brief Record the compute time of a cycle
+     *
+     * Real-time safe.
+     *
+     * @return Whether the cycle overran its deadline
+     */
+    bool recordComputeTime(int64_t nanoseconds);
+
+    //! What was recorded since the last call. Not real-time safe.
+    void summarize(PeriodSummary & summary);
+
+  private:
+    // Counters have a single writer, so no read-modify-write is needed
+    static void increment(std::atomic<uint64_t> & counter)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t m_nominal_period;
+    uint64_t m_late_period;
+    uint64_t m_deadline;
+    bool m_first;
+
+    LatencyHistogram m_periods;
+    LatencyHistogram m_jitter;
+    LatencyHistogram m_compute_times;
+    std::atomic<uint64_t> m_updates;
+    std::atomic<uint64_t> m_skipped;
+    std::atomic<uint64_t> m_late;
+    std::atomic<uint64_t> m_overruns;
+
+    // Owned by the summarizing thread
+    std::vector<uint64_t> m_window;
+    uint64_t m_seen_updates;
+    uint64_t m_seen_skipped;
+    uint64_t m_seen_late;
+    uint64_t m_seen_overruns;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef POINT_CLOUD_SURFACE_H_INCLUDED
+#define POINT_CLOUD_SURFACE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+struct SurfaceSample;
+
+/**
+ * @brief Scattered scan point with material labels
+ */
+struct SurfacePoint
+{
+  double x;
+  double y;
+  double z;
+  double stiffness;
+  double damping;
+};
+
+/**
+ * @brief Surface model for unstructured scan point clouds
+ *
+ * Points are binned into a uniform x/y bucket grid (a voxel hash whose hash
+ * is the cell index) stored in compressed rows. A query looks at the 3x3
+ * buckets around the query point, keeps the kNeighbors nearest points and
+ * fits a weighted plane through them for height and slope. Stiffness and
+ * damping are inverse-distance weighted.
+ *
+ * Buckets hold at most kMaxPointsPerBucket points, so each query inspects a
+ * bounded number of points regardless of the cloud size and density.
+ */
+class PointCloudSurface
+{
+  public:
+    static constexpr size_t kNeighbors = 8;
+    static constexpr size_t kMaxPointsPerBucket = 16;
+
+    //! Farthest the nearest point may be from a query, in bucket sizes
+    static constexpr double kMaxGap = 1.5;
+
+    /**
+     * @brief Build the bucket grid
+     *
+     * @param points The cloud. Consumed by the call.
+     * @param points_per_bucket Mean bucket occupancy the grid is sized for
+     *
+     * @return True if the cloud is non-empty and finite
+     */
+    bool build(std::vector<SurfacePoint> points, double points_per_bucket, std::string & error);
+
+    /**
+     * @brief Interpolate the surface at (\a x, \a y)
+     *
+     * Real-time safe. Searches one more ring of buckets if the 3x3
+     * neighbourhood is empty.
+     *
+     * @return False if the nearest point is more than kMaxGap buckets away,
+     * as outside the cloud
+     */
+    bool sample(double x, double y, SurfaceSample & sample) const;
+
+    size_t size() const { return m_points.size(); }
+
+    //! Points that were left out because their bucket was full
+    size_t droppedPoints() const { return m_dropped_points; }
+
+  private:
+    size_t bucketIndex(long ix, long iy) const { return static_cast<size_t>(iy) * m_nx + ix; }
+
+    std::vector<SurfacePoint> m_points;   // Sorted by bucket
+    std::vector<uint32_t> m_bucket_start;  // m_nx * m_ny + 1 offsets into m_points
+    double m_min_x = 0.0;
+    double m_min_y = 0.0;
+    double m_inv_bucket_size = 1.0;
+    long m_nx = 0;
+    long m_ny = 0;
+    size_t m_dropped_points = 0;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef REALTIME_LOANED_PUBLISHER_H_INCLUDED
+#define REALTIME_LOANED_PUBLISHER_H_INCLUDED
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Publishes messages that the real-time thread fills from a thread of its own
+ *
+ * Like realtime_tools::RealtimePublisher, but the publishing thread borrows
+ * a message from the middleware whenever it can loan messages, so that
+ * shared-memory transports hand the sample to subscribers without
+ * serializing or copying it again. Otherwise the message is published by
+ * reference. MessageT should have a fixed size, or loans are never offered.
+ *
+ * The real-time thread owns the message between tryAcquire() and publish().
+ * While the publishing thread still holds the previous one, tryAcquire()
+ * fails and the sample is dropped.
+ *
+ * As in realtime_tools::RealtimePublisher, publish() wakes the publishing
+ * thread only if it can take the mutex without waiting. A wakeup lost that
+ * way is made up for by kWakeupTimeout.
+ */
+template <typename MessageT>
+class RealtimeLoanedPublisher
+{
+  public:
+    explicit RealtimeLoanedPublisher(typename rclcpp::Publisher<MessageT>::SharedPtr publisher)
+    : m_publisher(std::move(publisher)), m_state(Idle), m_stop(false)
+    {
+      m_thread = std::thread(&RealtimeLoanedPublisher::publishingLoop, this);
+    }
+
+    ~RealtimeLoanedPublisher()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_ready_cv.notify_one();
+      m_thread.join();
+    }
+
+    RealtimeLoanedPublisher(const RealtimeLoanedPublisher &) = delete;
+    RealtimeLoanedPublisher & operator=(const RealtimeLoanedPublisher &) = delete;
+
+    //! Real-time safe. The message to fill, or nullptr while the last one is being published.
+    MessageT * tryAcquire()
+    {
+      int idle = Idle;
+      return m_state.compare_exchange_strong(idle, Filling, std::memory_order_acquire)
+               ? &m_message
+               : nullptr;
+    }
+
+    //! Real-time safe. Hand the acquired message to the publishing thread.
+    void publish()
+    {
+      m_state.store(Ready, std::memory_order_release);
+      if (m_mutex.try_lock())
+      {
+        m_ready_cv.notify_one();
+        m_mutex.unlock();
+      }
+    }
+
+    //! Whether the middleware loans messages of this type
+    bool loansMessages() const { return m_publisher->can_loan_messages(); }
+
+  private:
+    enum State
+    {
+      Idle,
+      Filling,
+      Ready
+    };
+
+    // Longest delay of a message whose wakeup was lost
+    static constexpr std::chrono::milliseconds kWakeupTimeout{10};
+
+    void publishingLoop()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stop)
+      {
+        const bool ready = m_ready_cv.wait_for(lock, kWakeupTimeout, [this] {
+          return m_stop || m_state.load(std::memory_order_acquire) == Ready;
+        });
+        if (!ready || m_stop)
+        {
+          continue;
+        }
+        lock.unlock();
+        if (m_publisher->can_loan_messages())
+        {
+          auto loaned = m_publisher->borrow_loaned_message();
+          loaned.get() = m_message;
+          m_publisher->publish(std::move(loaned));
+        }
+        else
+        {
+          m_publisher->publish(m_message);
+        }
+        m_state.store(Idle, std::memory_order_release);
+        lock.lock();
+      }
+    }
+
+    typename rclcpp::Publisher<MessageT>::SharedPtr m_publisher;
+    MessageT m_message;
+    std::atomic<int> m_state;
+    std::mutex m_mutex;
+    std::condition_variable m_ready_cv;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
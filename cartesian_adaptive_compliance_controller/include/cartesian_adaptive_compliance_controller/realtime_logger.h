@@ -0,0 +1,150 @@
+#ifndef REALTIME_LOGGER_H_INCLUDED
+#define REALTIME_LOGGER_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/spsc_queue.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Registry of the messages of the control loop
+ *
+ * Each entry is MESSAGE(name, level, minimum interval in s, format), where
+ * every {} in the format takes the next argument. Messages of one entry
+ * that come within its minimum interval are dropped.
+ */
+#define ADAPTIVE_COMPLIANCE_LOG_MESSAGES(MESSAGE)                     \
+  MESSAGE(EmptyTank, Warn, 1.0, "empty tank")                         \
+  MESSAGE(QpError, Warn, 1.0, "QP solver error: {}")                  \
+  MESSAGE(NoSurfaceMap, Warn, 1.0, "no surface map, cycle skipped")   \
+  MESSAGE(CycleReport, Info, 0.0,                                     \
+          "#########################################################\n" \
+          " z_pos : {} | des {} | surf: {} | surf vel: {}\n"           \
+          "EE velocity: {} | ik vel{}\n"                               \
+          "Kd: {} {} {}\n"                                             \
+          "Tank: {} | Tank_dot: {} |  threshold: {}\n"                 \
+          "F_ext: {}|  F_des: {}|  F_min: {} | F_ft: {}\n"             \
+          "Stiffness: {} | Damping: {}\n"                              \
+          "deltaT {}")
+
+enum class LogLevel : uint8_t
+{
+  Info,
+  Warn,
+  Error
+};
+
+enum class LogMessage : uint8_t
+{
+#define LOG_MESSAGE_NAME(name, level, interval, format) name,
+  ADAPTIVE_COMPLIANCE_LOG_MESSAGES(LOG_MESSAGE_NAME)
+#undef LOG_MESSAGE_NAME
+  Count
+};
+
+constexpr size_t kLogMessages = static_cast<size_t>(LogMessage::Count);
+
+/**
+ * @brief Logs from the real-time thread without formatting or I/O there
+ *
+ * The real-time thread queues the message ID and its arguments into a
+ * preallocated lock-free queue. A background thread formats them and hands
+ * the text to the sink. A message that comes within its minimum interval of
+ * the last one of its kind is dropped, and the next one that gets through
+ * tells how many were. So do messages that find the queue full.
+ */
+class RealtimeLogger
+{
+  public:
+    static constexpr size_t kMaxArguments = 20;
+    static constexpr size_t kQueueSize = 256;
+
+    using Sink = std::function<void(LogLevel level, const std::string & text)>;
+
+    RealtimeLogger();
+    ~RealtimeLogger();
+
+    RealtimeLogger(const RealtimeLogger &) = delete;
+    RealtimeLogger & operator=(const RealtimeLogger &) = delete;
+
+    //! Start the formatting thread. Not while the real-time thread logs.
+    void start(Sink sink);
+
+    //! Format what is queued and stop. Not while the real-time thread logs.
+    void stop();
+
+    bool isRunning() const { return m_worker.joinable(); }
+
+    //! Real-time safe. Does nothing unless running.
+    template <typename... Arguments>
+    void log(LogMessage message, Arguments... arguments)
+    {
+      static_assert(sizeof...(Arguments) <= kMaxArguments, "Too many log arguments");
+      if (!isRunning())
+      {
+        return;
+      }
+      const size_t index = static_cast<size_t>(message);
+      const auto now = std::chrono::steady_clock::now();
+      if (now < m_next[index])
+      {
+        ++m_suppressed[index];
+        return;
+      }
+      m_next[index] = now + kIntervals[index];
+
+      Entry entry;
+      entry.message = message;
+      entry.suppressed = m_suppressed[index];
+      entry.count = sizeof...(Arguments);
+      entry.arguments = {{static_cast<double>(arguments)...}};
+      if (m_entries.push(entry))
+      {
+        m_suppressed[index] = 0;
+      }
+      else
+      {
+        ++m_suppressed[index];
+      }
+    }
+
+  private:
+    struct Entry
+    {
+      LogMessage message;
+      uint32_t suppressed;
+      uint32_t count;
+      std::array<double, kMaxArguments> arguments;
+    };
+
+    static const std::chrono::steady_clock::duration kIntervals[kLogMessages];
+
+    void workerLoop();
+    void drain();
+
+    SpscQueue<Entry, kQueueSize> m_entries;
+
+    // Owned by the real-time thread
+    std::chrono::steady_clock::time_point m_next[kLogMessages];
+    uint32_t m_suppressed[kLogMessages];
+
+    Sink m_sink;
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+    bool m_stop;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SIGNED_DISTANCE_FIELD_H_INCLUDED
+#define SIGNED_DISTANCE_FIELD_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Distance to the workpiece surface on a regular 3-D grid
+ *
+ * Positive above the surface, negative below it, and clamped to +/- \a band.
+ * Values are stored as floats in x-major order with z varying fastest, so a
+ * query touches two adjacent pairs of cache lines per x/y corner.
+ */
+struct SignedDistanceField
+{
+  ArrayView<float> values;
+  double origin[3] = {0.0, 0.0, 0.0};
+  double resolution = 0.0;
+  double band = 0.0;
+  size_t nx = 0;
+  size_t ny = 0;
+  size_t nz = 0;
+
+  bool empty() const { return values.empty(); }
+
+  /**
+   * @brief Trilinear lookup of the distance and its gradient at \a p
+   *
+   * O(1), allocation-free and real-time safe. Points outside the grid are
+   * clamped onto it.
+   */
+  void query(const double p[3], double & distance, double gradient[3]) const;
+};
+
+/**
+ * @brief Sample the signed distance to the surface of \a map
+ *
+ * Only the full resolution grid is considered. Point cloud maps get no field.
+ *
+ * @param resolution Voxel edge length. Raised to the map's cell size if finer.
+ * @param band Distances beyond this are clamped
+ * @param values Backing memory for \a field
+ */
+void computeSignedDistanceField(const SurfaceMap & map, double resolution, double band,
+                                std::vector<float> & values, SignedDistanceField & field);
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SPSC_QUEUE_H_INCLUDED
+#define SPSC_QUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Fixed-capacity queue between one producer and one consumer thread
+ *
+ * Lock-free and allocation-free, so either side may be the real-time thread.
+ * Pushing to a full queue fails instead of blocking.
+ *
+ * @tparam Capacity A power of two
+ */
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  public:
+    //! Producer side. False if the queue is full.
+    bool push(const T & item)
+    {
+      const size_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      {
+        return false;
+      }
+      m_items[tail & (Capacity - 1)] = item;
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    //! Consumer side. False if the queue is empty.
+    bool pop(T & item)
+    {
+      const size_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      item = m_items[head & (Capacity - 1)];
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    //! Drop everything. Only while neither side is active.
+    void clear()
+    {
+      m_head.store(0);
+      m_tail.store(0);
+    }
+
+  private:
+    T m_items[Capacity];
+
+    // On separate cache lines, so that the two sides do not contend
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
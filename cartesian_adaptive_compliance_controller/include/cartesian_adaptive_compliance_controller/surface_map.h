@@ -0,0 +1,450 @@
+#ifndef SURFACE_MAP_H_INCLUDED
+#define SURFACE_MAP_H_INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Read-only view of a contiguous array that is owned elsewhere
+ */
+template <typename T>
+struct ArrayView
+{
+  const T * data = nullptr;
+  size_t size = 0;
+
+  ArrayView() = default;
+  ArrayView(const T * d, size_t s) : data(d), size(s) {}
+  ArrayView(const std::vector<T> & v) : data(v.data()), size(v.size()) {}
+
+  const T & operator[](size_t i) const { return data[i]; }
+  const T * begin() const { return data; }
+  const T * end() const { return data + size; }
+  bool empty() const { return size == 0; }
+};
+
+class MaterialVolume;
+class PointCloudSurface;
+struct SignedDistanceField;
+
+/**
+ * @brief Contact model of one material
+ *
+ * At penetration p, the material resists with
+ * `stiffness * p^exponent - damping * p^exponent * v`.
+ */
+struct MaterialParameters
+{
+  double stiffness = 0.0;
+  double damping = 0.0;
+  double exponent = 1.35;
+
+  //! Penetration the controller aims for
+  double max_penetration = 0.008;
+
+  //! Lower bound of the vertical force reference in contact
+  double min_force = -9.0;
+};
+
+//! Material IDs are bytes
+constexpr size_t kMaxMaterials = 256;
+
+/**
+ * @brief Surface properties at one point of the workpiece
+ */
+struct SurfaceSample
+{
+  double z = 0.0;
+  double stiffness = 0.0;
+  double damping = 0.0;
+  double dz_dx = 0.0;
+  double dz_dy = 0.0;
+
+  //! Rate of change of the height, nonzero only for time-varying surfaces
+  double dz_dt = 0.0;
+
+  //! Contact model of the cell, only for maps with material IDs
+  const MaterialParameters * material = nullptr;
+};
+
+/**
+ * @brief Affine decoding of the codes in one tile of a QuantizedField
+ */
+struct QuantizationTile
+{
+  double offset = 0.0;
+  double scale = 0.0;
+};
+
+/**
+ * @brief A per-cell field stored as 16 bit codes
+ *
+ * The grid is divided into square tiles of kTileSize cells, each with its
+ * own offset and scale, so the resolution adapts to the local value range.
+ * Codes are stored row-major like the double fields.
+ */
+struct QuantizedField
+{
+  static constexpr size_t kTileSize = 16;
+
+  ArrayView<uint16_t> codes;
+  ArrayView<QuantizationTile> tiles;
+  size_t tile_cols = 0;
+
+  bool empty() const { return codes.empty(); }
+
+  double decode(size_t x_index, size_t y_index, size_t cols) const
+  {
+    const QuantizationTile & tile = tiles[(x_index / kTileSize) * tile_cols + y_index / kTileSize];
+    return tile.offset + tile.scale * codes[x_index * cols + y_index];
+  }
+};
+
+/**
+ * @brief Height, stiffness and damping of the workpiece on a rectilinear x/y grid
+ *
+ * Per-cell fields are stored row-major with one row per x coordinate.
+ * A grid only holds views of memory that is owned by its SurfaceMap.
+ * Stiffness and damping are either doubles, quantized, or given by a
+ * material ID per cell that indexes a table of kMaxMaterials materials.
+ */
+struct SurfaceGrid
+{
+  ArrayView<double> x_coordinates;
+  ArrayView<double> y_coordinates;
+  ArrayView<double> z_values;
+  ArrayView<double> stiffness_values;
+  ArrayView<double> damping_values;
+
+  // Surface slope, precomputed at load time
+  ArrayView<double> dz_dx_values;
+  ArrayView<double> dz_dy_values;
+
+  // Replace the stiffness and damping values of quantized maps
+  QuantizedField stiffness_quantized;
+  QuantizedField damping_quantized;
+
+  // Replace the stiffness and damping values of maps made of few materials
+  ArrayView<uint8_t> material_ids;
+  ArrayView<MaterialParameters> materials;
+
+  //! Mean spacing of the grid, the larger of both axes
+  double cell_size = 0.0;
+
+  size_t rows() const { return x_coordinates.size; }
+  size_t cols() const { return y_coordinates.size; }
+  size_t cellIndex(size_t x_index, size_t y_index) const { return x_index * cols() + y_index; }
+
+  double z(size_t x_index, size_t y_index) const { return z_values[cellIndex(x_index, y_index)]; }
+  double stiffness(size_t x_index, size_t y_index) const
+  {
+    if (hasMaterials())
+    {
+      return material(x_index, y_index).stiffness;
+    }
+    return stiffness_quantized.empty() ? stiffness_values[cellIndex(x_index, y_index)]
+                                       : stiffness_quantized.decode(x_index, y_index, cols());
+  }
+  double damping(size_t x_index, size_t y_index) const
+  {
+    if (hasMaterials())
+    {
+      return material(x_index, y_index).damping;
+    }
+    return damping_quantized.empty() ? damping_values[cellIndex(x_index, y_index)]
+                                     : damping_quantized.decode(x_index, y_index, cols());
+  }
+  const MaterialParameters & material(size_t x_index, size_t y_index) const
+  {
+    return materials[material_ids[cellIndex(x_index, y_index)]];
+  }
+  bool quantized() const { return !stiffness_quantized.empty(); }
+  bool hasMaterials() const { return !material_ids.empty(); }
+};
+
+/**
+ * @brief A surface grid at full resolution plus its coarser pyramid levels
+ *
+ * Each pyramid level halves the resolution of the one before by averaging
+ * 2x2 blocks of cells. The memory behind all views is kept alive by
+ * \a storage, which may be a private buffer or a shared memory mapping.
+ * Once handed to the control loop, a map is never modified.
+ *
+ * Maps from unstructured scans have no grid and use \a point_cloud instead.
+ */
+struct SurfaceMap : public SurfaceGrid
+{
+  //! Level 1, 2, ... of the pyramid. Level 0 is the map itself.
+  std::vector<SurfaceGrid> levels;
+
+  std::shared_ptr<const PointCloudSurface> point_cloud;
+
+  //! Distance to the surface for contact prediction, empty for point clouds
+  std::shared_ptr<const SignedDistanceField> distance_field;
+
+  //! Depth-dependent stiffness and damping, if the map has a volume file
+  std::shared_ptr<const MaterialVolume> material_volume;
+
+  //! Where the map was loaded from, for diagnostics
+  std::string source;
+
+  //! Per-file read times of maps loaded from text files
+  std::string load_report;
+
+  //! Incremented by the publisher each time a shared map is replaced
+  uint64_t generation = 0;
+
+  std::shared_ptr<const void> storage;
+
+  size_t levelCount() const { return levels.size() + 1; }
+  const SurfaceGrid & level(size_t index) const { return index == 0 ? *this : levels[index - 1]; }
+
+  /**
+   * @brief The coarsest level whose cells are no larger than \a travel
+   *
+   * Detail that the end effector passes within one control cycle would be
+   * aliased, so there is no point in looking it up.
+   *
+   * @param travel Distance covered on the map within one control cycle
+   */
+  size_t selectLevel(double travel) const
+  {
+    size_t index = 0;
+    while (index < levels.size() && levels[index].cell_size <= travel)
+    {
+      ++index;
+    }
+    return index;
+  }
+};
+
+//! Pyramids stop at this many levels, including the full resolution
+constexpr size_t kMaxSurfaceMapLevels = 6;
+
+//! Voxel size of the signed distance field, unless the map is coarser
+constexpr double kDistanceFieldResolution = 0.002;
+
+//! Distances to the surface are only resolved up to this
+constexpr double kDistanceFieldBand = 0.02;
+
+//! Height of the scanned surface above the one in the MATLAB text files
+constexpr double kScanZOffset = 0.0015;
+
+//! File name of compiled maps inside a map directory
+constexpr const char * kSurfaceMapImageName = "surface_map.smap";
+
+//! Steps of the neighbourhood walk before a lookup falls back to a global search
+constexpr size_t kMaxCursorSteps = 8;
+
+/**
+ * @brief Index of the coordinate closest to \a target, by binary search
+ *
+ * Of two equally close coordinates, the lower index wins.
+ */
+inline size_t findClosestIndex(ArrayView<double> coordinates, double target)
+{
+  const double * upper = std::lower_bound(coordinates.begin(), coordinates.end(), target);
+  if (upper == coordinates.begin())
+  {
+    return 0;
+  }
+  if (upper == coordinates.end())
+  {
+    return coordinates.size - 1;
+  }
+  const size_t index = upper - coordinates.begin();
+  return coordinates[index] - target < target - coordinates[index - 1] ? index : index - 1;
+}
+
+/**
+ * @brief Index of the coordinate closest to \a target, walking from \a hint
+ *
+ * Takes a few comparisons when \a target is near the coordinate at \a hint,
+ * as it is between consecutive control cycles. Falls back to a global search
+ * after kMaxCursorSteps steps. Works on non-uniform grids.
+ */
+inline size_t findClosestIndex(ArrayView<double> coordinates, double target, size_t hint)
+{
+  const size_t last = coordinates.size - 1;
+  size_t i = hint < last ? hint : last;
+  size_t steps = 0;
+
+  // Walk to the last coordinate not above the target
+  while (i < last && coordinates[i + 1] <= target && steps < kMaxCursorSteps)
+  {
+    ++i;
+    ++steps;
+  }
+  while (i > 0 && coordinates[i] > target && steps < kMaxCursorSteps)
+  {
+    --i;
+    ++steps;
+  }
+  if (steps == kMaxCursorSteps)
+  {
+    return findClosestIndex(coordinates, target);
+  }
+  return i < last && coordinates[i + 1] - target < target - coordinates[i] ? i + 1 : i;
+}
+
+/**
+ * @brief Grid cell around \a target along one axis with ascending \a coordinates
+ *
+ * @param nearest The index closest to \a target
+ * @param lower Lower index of the enclosing cell
+ * @param t Position of \a target inside that cell in [0, 1]
+ */
+inline void findEnclosingCell(ArrayView<double> coordinates, size_t nearest, double target,
+                              size_t & lower, double & t)
+{
+  if (coordinates.size < 2)
+  {
+    lower = 0;
+    t = 0.0;
+    return;
+  }
+  lower = (target < coordinates[nearest] && nearest > 0) ? nearest - 1 : nearest;
+  if (lower >= coordinates.size - 1)
+  {
+    lower = coordinates.size - 2;
+  }
+  const double width = coordinates[lower + 1] - coordinates[lower];
+  t = width != 0.0 ? (target - coordinates[lower]) / width : 0.0;
+  t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+}
+
+/**
+ * @brief Bilinear interpolation of a per-cell \a field at (\a x, \a y)
+ *
+ * @param x_index Index of the x coordinate closest to \a x
+ * @param y_index Index of the y coordinate closest to \a y
+ */
+inline double interpolate(const SurfaceGrid & map, ArrayView<double> field, size_t x_index,
+                          size_t y_index, double x, double y)
+{
+  size_t i, j;
+  double tx, ty;
+  findEnclosingCell(map.x_coordinates, x_index, x, i, tx);
+  findEnclosingCell(map.y_coordinates, y_index, y, j, ty);
+  const size_t i1 = map.rows() > 1 ? i + 1 : i;
+  const size_t j1 = map.cols() > 1 ? j + 1 : j;
+
+  const double v00 = field[map.cellIndex(i, j)];
+  const double v01 = field[map.cellIndex(i, j1)];
+  const double v10 = field[map.cellIndex(i1, j)];
+  const double v11 = field[map.cellIndex(i1, j1)];
+  return (1.0 - tx) * ((1.0 - ty) * v00 + ty * v01) + tx * ((1.0 - ty) * v10 + ty * v11);
+}
+
+/**
+ * @brief Compute the surface slopes dz/dx and dz/dy of \a grid
+ *
+ * Uses central differences on the (possibly non-uniform) grid and one-sided
+ * differences at the borders.
+ */
+void computeSurfaceGradients(const SurfaceGrid & grid, std::vector<double> & dz_dx,
+                             std::vector<double> & dz_dy);
+
+/**
+ * @brief Complete \a map with everything that can be derived from its base grid
+ *
+ * Computes the cell size, and the gradients, pyramid levels and signed
+ * distance field unless they were loaded already. The map keeps its previous
+ * storage alive.
+ */
+void computeDerivedFields(SurfaceMap & map);
+
+/**
+ * @brief Store stiffness and damping of all levels of \a map as 16 bit codes
+ *
+ * Lookups then touch a quarter of the memory for these fields. The double
+ * fields are freed: the remaining fields are copied into new storage and the
+ * previous one is released, also for maps in shared memory. Point cloud maps
+ * are left unchanged.
+ *
+ * @param report Memory use and the largest decoding errors, per field
+ */
+void quantizeSurfaceMap(SurfaceMap & map, std::string & report);
+
+/**
+ * @brief Where the previous lookup of a caller ended up
+ *
+ * Successive lookups along a continuous path start their search from there.
+ */
+struct SurfaceCursor
+{
+  const SurfaceMap * map = nullptr;
+  size_t level = 0;
+  size_t x_index = 0;
+  size_t y_index = 0;
+};
+
+/**
+ * @brief Look up the surface at (\a x, \a y)
+ *
+ * Real-time safe. Grids are sampled at the nearest cell on the pyramid level
+ * selected by \a travel, with bilinearly interpolated slopes.
+ *
+ * @param travel Distance covered on the map within one control cycle
+ * @param cursor Search hint from the caller's previous lookup, updated
+ *
+ * @return False if the map has no data near the query
+ */
+bool sampleSurface(const SurfaceMap & map, double x, double y, double travel,
+                   SurfaceCursor & cursor, SurfaceSample & sample);
+
+/**
+ * @brief Read a surface map from the MATLAB text files in \a directory
+ *
+ * A points.txt file with one `x y z stiffness damping` line per scan point
+ * takes precedence over the grid files. With a materials.txt table, the
+ * stiffness and damping files are replaced by material IDs in material.txt,
+ * see materialMapReader(). All derived fields are computed.
+ *
+ * @param directory Folder containing x.txt, y.txt, z.txt, stiffness.txt and damping.txt
+ * @param z_offset Added to all heights
+ * @param map The map to fill. It owns its memory afterwards.
+ * @param error Reason for failure, if any
+ *
+ * @return True if the files could be read and form a consistent map
+ */
+bool readSurfaceMapText(const std::string & directory, double z_offset, SurfaceMap & map,
+                        std::string & error);
+
+/**
+ * @brief Load the surface map in \a directory
+ *
+ * A `surface_map.smap` image from surface_map_compiler is mapped as is and
+ * takes precedence over the text files, which are read with the
+ * kScanZOffset, unless one of them is newer than the image. The load report
+ * then says that the image was ignored. \a directory may also name an image
+ * file directly.
+ *
+ * A kMaterialVolumeName file next to the map is read into its material volume.
+ *
+ * @return True if the map could be read and is consistent
+ */
+bool loadSurfaceMap(const std::string & directory, SurfaceMap & map, std::string & error);
+
+/**
+ * @brief Check that all fields of \a map agree in their dimensions
+ *
+ * Grid coordinates must also be finite and strictly ascending, and the
+ * materials the cells refer to finite with a positive exponent and
+ * penetration.
+ *
+ * @return True if the map can safely be indexed by the control loop
+ */
+bool validateSurfaceMap(const SurfaceMap & map, std::string & error);
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SURFACE_MAP_IMAGE_H_INCLUDED
+#define SURFACE_MAP_IMAGE_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Flat, position-independent memory layout of a SurfaceMap
+ *
+ * An image is a header followed by 64-byte aligned sections. It can be
+ * placed in shared memory or a file and viewed in place without copying.
+ * Readers skip sections they do not know, whatever their element size, so
+ * new sections can be added without changing the version. Version 2 readers
+ * required double sections throughout and reject the float distance field,
+ * hence version 3. Version 2 images are still read.
+ */
+namespace surface_map_image
+{
+constexpr uint32_t kMagic = 0x50414d53;  // "SMAP"
+constexpr uint32_t kVersion = 3;
+constexpr uint32_t kMinVersion = 2;
+constexpr size_t kAlignment = 64;
+constexpr size_t kMaxSections = 48;
+
+enum class SectionId : uint32_t
+{
+  XCoordinates = 1,
+  YCoordinates = 2,
+  Z = 3,
+  Stiffness = 4,
+  Damping = 5,
+  DzDx = 6,
+  DzDy = 7,
+  DistanceFieldGrid = 8,  // Origin, resolution, band and size of the distance field
+  DistanceField = 9,      // float
+  MaterialIds = 10,       // uint8_t
+  Materials = 11,         // MaterialParameters, only on level 0
+};
+
+struct Section
+{
+  uint32_t id;
+  uint16_t element_size;
+  uint16_t level;   // Pyramid level, 0 is full resolution
+  uint64_t offset;  // From the start of the image
+  uint64_t count;
+};
+
+struct Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+  uint64_t total_size;
+  uint64_t rows;
+  uint64_t cols;
+  uint32_t section_count;
+  uint32_t reserved;
+  Section sections[kMaxSections];
+};
+}  // namespace surface_map_image
+
+/**
+ * @brief Number of bytes needed to store \a map as an image
+ */
+size_t surfaceMapImageSize(const SurfaceMap & map);
+
+/**
+ * @brief Serialize \a map into \a buffer
+ *
+ * @param buffer At least surfaceMapImageSize(map) bytes, aligned to 64 bytes
+ */
+void writeSurfaceMapImage(const SurfaceMap & map, uint64_t generation, void * buffer);
+
+/**
+ * @brief Create a map that views the image in \a buffer without copying
+ *
+ * @param storage Keeps \a buffer alive for as long as the map exists
+ *
+ * @return True if the image is complete and describes a valid map
+ */
+bool viewSurfaceMapImage(const void * buffer, size_t size, std::shared_ptr<const void> storage,
+                         SurfaceMap & map, std::string & error);
+
+/**
+ * @brief Map an image file, e.g. from surface_map_compiler, and view it
+ *
+ * Nothing is recomputed for images that contain the derived fields.
+ */
+bool loadSurfaceMapImage(const std::string & filename, SurfaceMap & map, std::string & error);
+
+/**
+ * @brief Write \a map as an image file
+ *
+ * The file is replaced atomically.
+ */
+bool saveSurfaceMapImage(const std::string & filename, const SurfaceMap & map,
+                         std::string & error);
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SURFACE_MAP_LEARNER_H_INCLUDED
+#define SURFACE_MAP_LEARNER_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/spsc_queue.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief One cycle of contact with the surface
+ */
+struct ContactObservation
+{
+  double x = 0.0;
+  double y = 0.0;
+
+  //! Depth below the surface of the map, without learned height offsets
+  double penetration = 0.0;
+
+  //! Velocity into the surface, relative to the surface itself
+  double velocity = 0.0;
+
+  //! Measured contact force, positive when pushing into the surface
+  double force = 0.0;
+
+  //! The map's values at (x, y), the starting point of the estimate
+  double stiffness = 0.0;
+  double damping = 0.0;
+
+  //! Of the contact model at (x, y)
+  double exponent = 1.35;
+};
+
+/**
+ * @brief Refines the height, stiffness and damping of a surface map from contact forces
+ *
+ * The real-time thread reports contact observations, which a background
+ * thread fits per grid cell to the contact model
+ * `force = stiffness * p^exponent - damping * p^exponent * v` by recursive least
+ * squares with exponential forgetting. The penetration p is that below the
+ * map's surface plus a learned height offset of the cell, which enters the
+ * model nonlinearly, so the fit is linearized around the current estimate
+ * in every step. Refined cell values come back through
+ * a queue, and the real-time thread applies a bounded number of them per
+ * cycle to its own table of learned cells. Maps stay immutable; learned
+ * values override them where they exist.
+ *
+ * Both queues are lock-free. Observations are dropped if the estimator falls
+ * behind.
+ */
+class SurfaceMapLearner
+{
+  public:
+    static constexpr size_t kQueueSize = 1024;
+
+    //! Learned values the real-time thread applies per call to applyUpdates()
+    static constexpr size_t kMaxUpdatesPerCycle = 16;
+
+    SurfaceMapLearner();
+    ~SurfaceMapLearner();
+
+    SurfaceMapLearner(const SurfaceMapLearner &) = delete;
+    SurfaceMapLearner & operator=(const SurfaceMapLearner &) = delete;
+
+    /**
+     * @brief Start learning on the cells of \a grid, discarding earlier results
+     *
+     * Not while the real-time thread uses the learner. Only the grid's
+     * coordinates are kept.
+     *
+     * @param forgetting Weight of the previous estimate per observation, in (0, 1]
+     *
+     * @return False for grids without cells, such as point clouds
+     */
+    bool start(const SurfaceGrid & grid, double forgetting);
+
+    //! Stop the estimator and discard the learned cells
+    void stop();
+
+    bool isRunning() const { return m_worker.joinable(); }
+
+    /**
+     * @brief Whether \a grid has the cells that are being learned
+     *
+     * Real-time safe. Compares size and extent, so a map replaced by one of
+     * the same grid keeps its learned values.
+     */
+    bool matches(const SurfaceGrid & grid) const;
+
+    //! Real-time safe. Queue an observation for the estimator.
+    void observe(const ContactObservation & observation);
+
+    //! Real-time safe. Take over up to kMaxUpdatesPerCycle refined cells.
+    void applyUpdates();
+
+    /**
+     * @brief Replace the map's values at (\a x, \a y) by learned ones, if any
+     *
+     * Real-time safe.
+     *
+     * @param height Set to how far the surface lies above the map's height
+     *
+     * @return True if the cell has been learned
+     */
+    bool correct(double x, double y, double & height, double & stiffness, double & damping);
+
+    //! Cells with learned values, as seen by the real-time thread
+    size_t learnedCells() const { return m_learned_count.load(); }
+
+    //! Observations lost because the estimator fell behind
+    uint64_t droppedObservations() const { return m_dropped.load(); }
+
+  private:
+    // Stiffness, damping and height offset
+    static constexpr int kParameters = 3;
+
+    struct Update
+    {
+      size_t cell;
+      float height;
+      float stiffness;
+      float damping;
+    };
+
+    // Stiffness is NaN until learned
+    struct LearnedCell
+    {
+      float height;
+      float stiffness;
+      float damping;
+    };
+
+    // Estimate of one cell, owned by the estimator thread
+    struct Estimate
+    {
+      // In the linearized model of update(), with the exponent it assumes
+      double theta[kParameters];
+      double covariance[kParameters][kParameters];
+
+      // Bounds the covariance while the observations do not excite a parameter
+      double covariance_limit[kParameters];
+
+      double exponent;
+
+      // Waiting in m_pending for room in the update queue
+      bool pending;
+    };
+
+    void workerLoop();
+    bool cellIndex(double x, double y, size_t & x_hint, size_t & y_hint, size_t & cell) const;
+    void update(const ContactObservation & observation);
+    Update result(size_t cell) const;
+
+    // Constant while running
+    std::vector<double> m_x_coordinates;
+    std::vector<double> m_y_coordinates;
+    double m_forgetting;
+
+    SpscQueue<ContactObservation, kQueueSize> m_observations;
+    SpscQueue<Update, kQueueSize> m_updates;
+
+    // Owned by the real-time thread
+    std::vector<LearnedCell> m_cells;
+    size_t m_x_hint;
+    size_t m_y_hint;
+
+    // Owned by the estimator thread. Only touched cells are estimated.
+    std::unordered_map<size_t, Estimate> m_estimates;
+    std::vector<size_t> m_pending;
+    size_t m_worker_x_hint;
+    size_t m_worker_y_hint;
+
+    std::atomic<size_t> m_learned_count;
+    std::atomic<uint64_t> m_dropped;
+
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+    bool m_stop;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef SURFACE_MAP_LOADER_H_INCLUDED
+#define SURFACE_MAP_LOADER_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Loads surface maps in the background and hands them to the control loop
+ *
+ * The current map is published through an atomic pointer (RCU-style).
+ * The real-time thread pins the map for one cycle with a ReadGuard, which
+ * costs two atomic increments and never blocks. The loader thread swaps in
+ * new maps at any time and frees the old one only after the real-time thread
+ * has left its read section, so no deallocation ever happens on the
+ * real-time side.
+ *
+ * There must be at most one real-time reader.
+ */
+class SurfaceMapLoader
+{
+  public:
+    SurfaceMapLoader();
+    ~SurfaceMapLoader();
+
+    SurfaceMapLoader(const SurfaceMapLoader &) = delete;
+    SurfaceMapLoader & operator=(const SurfaceMapLoader &) = delete;
+
+    /**
+     * @brief Load and publish a map synchronously
+     *
+     * Meant for the configuration phase, before the control loop runs.
+     *
+     * @return True if the map was valid and is now the current one
+     */
+    bool loadNow(const std::string & directory, std::string & error);
+
+    /**
+     * @brief Attach to a map in shared memory and follow its updates
+     *
+     * The map is attached synchronously. From then on, the background thread
+     * polls the generation counter and swaps in each new generation.
+     *
+     * @return True if a valid map was attached and is now the current one
+     */
+    bool attachSharedNow(const std::string & name, std::string & error);
+
+    /**
+     * @brief Start loading a map in the background
+     *
+     * A request that arrives while another load is pending replaces the
+     * pending one. Following a shared map stops with this request.
+     */
+    void requestLoad(const std::string & directory);
+
+    /**
+     * @brief Drop the current map, so that readers get none
+     *
+     * Cancels a pending load and stops following a shared map. A load the
+     * background thread is already running may still publish its map.
+     */
+    void clear();
+
+    /**
+     * @brief Store stiffness and damping of the maps loaded from now on as 16 bit codes
+     *
+     * See quantizeSurfaceMap(). The accuracy is appended to each map's load report.
+     */
+    void setQuantize(bool quantize) { m_quantize = quantize; }
+
+    //! Outcome of the most recent load, empty on success
+    std::string lastError() const;
+
+    /**
+     * @brief Report failed background loads to \a handler
+     *
+     * The handler runs on the loader thread. Synchronous loads return their
+     * error instead.
+     */
+    void setErrorHandler(std::function<void(const std::string & error)> handler);
+
+    //! Whether a map has been published at all
+    bool hasMap() const { return m_current.load() != nullptr; }
+
+    /**
+     * @brief Pins the current map for the lifetime of the guard
+     *
+     * Real-time safe. Keep the guard for no longer than one control cycle.
+     */
+    class ReadGuard
+    {
+      public:
+        explicit ReadGuard(SurfaceMapLoader & loader);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard & operator=(const ReadGuard &) = delete;
+
+        const SurfaceMap * get() const { return m_map; }
+
+      private:
+        SurfaceMapLoader & m_loader;
+        const SurfaceMap * m_map;
+    };
+
+  private:
+    void workerLoop();
+    bool load(const std::string & directory, std::string & error);
+    bool attachShared(const std::string & name, std::string & error);
+    bool finish(std::unique_ptr<SurfaceMap> map, bool ok, bool shared, std::string & error);
+    void quantize(SurfaceMap & map) const;
+    void publish(std::unique_ptr<SurfaceMap> map);
+
+    std::atomic<const SurfaceMap *> m_current;
+
+    // Odd while the real-time thread is inside a read section.
+    std::atomic<uint64_t> m_reader_sequence;
+
+    std::atomic<bool> m_quantize;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_request_cv;
+    std::string m_pending_directory;
+    std::string m_last_error;
+    std::function<void(const std::string & error)> m_error_handler;
+    std::string m_shared_name;
+    uint64_t m_shared_generation;
+    bool m_load_pending;
+    bool m_stop;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
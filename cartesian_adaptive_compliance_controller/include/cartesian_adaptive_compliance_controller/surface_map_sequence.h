@@ -0,0 +1,162 @@
+#ifndef SURFACE_MAP_SEQUENCE_H_INCLUDED
+#define SURFACE_MAP_SEQUENCE_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief The maps that describe the surface at one point in time
+ *
+ * The surface is \a current blended towards \a next by \a weight. Static maps
+ * have no \a next.
+ */
+struct SurfaceFrames
+{
+  const SurfaceMap * current = nullptr;
+  const SurfaceMap * next = nullptr;
+  double weight = 0.0;
+
+  //! Time from \a current to \a next
+  double interval = 0.0;
+};
+
+/**
+ * @brief Look up the surface at (\a x, \a y), interpolated between two frames
+ *
+ * Real-time safe. Also fills in the rate of change of the height. If \a next
+ * has no data at the query, the current frame is used alone.
+ *
+ * @param cursor Search hint for \a current, updated
+ */
+bool sampleSurface(const SurfaceFrames & frames, double x, double y, double travel,
+                   SurfaceCursor & cursor, SurfaceSample & sample);
+
+/**
+ * @brief Streams a time-varying surface from disk
+ *
+ * A sequence is a `sequence.txt` file with one `<time> <map>` line per frame,
+ * times in seconds and strictly ascending, maps as accepted by
+ * loadSurfaceMap() and relative to the file. Compiled maps load fastest.
+ *
+ * kFrameSlots frames are kept in memory, plus the one being loaded, however
+ * long the sequence. A background thread keeps the frames ahead of the reader's time
+ * loaded. The real-time thread never waits for a frame: while the next one
+ * is missing, the current one is held. Frames that fail to load are skipped.
+ *
+ * As with SurfaceMapLoader, there must be at most one real-time reader.
+ */
+class SurfaceMapSequence
+{
+  public:
+    static constexpr size_t kFrameSlots = 4;
+
+    SurfaceMapSequence();
+    ~SurfaceMapSequence();
+
+    SurfaceMapSequence(const SurfaceMapSequence &) = delete;
+    SurfaceMapSequence & operator=(const SurfaceMapSequence &) = delete;
+
+    /**
+     * @brief Read the sequence and load its first frames synchronously
+     *
+     * Meant for the configuration phase, before the control loop runs.
+     *
+     * @param path A sequence.txt file or the directory that contains it
+     * @param loop Start over after the last frame, which should then equal the first
+     *
+     * @return True if the sequence is valid and its first frames could be loaded
+     */
+    bool open(const std::string & path, bool loop, std::string & error);
+
+    //! Stop streaming and free all frames. Not while a reader is active.
+    void close();
+
+    bool isOpen() const { return !m_frames.empty(); }
+
+    //! Outcome of the most recent frame load, empty on success
+    std::string lastError() const;
+
+    /**
+     * @brief Pins the frames around \a time for the lifetime of the guard
+     *
+     * Real-time safe. Keep the guard for no longer than one control cycle.
+     * The frames are empty if no sequence is open.
+     *
+     * @param time Seconds since the start of the sequence
+     */
+    class ReadGuard
+    {
+      public:
+        ReadGuard(SurfaceMapSequence & sequence, double time);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard & operator=(const ReadGuard &) = delete;
+
+        const SurfaceFrames & get() const { return m_frames; }
+
+      private:
+        SurfaceMapSequence & m_sequence;
+        SurfaceFrames m_frames;
+    };
+
+  private:
+    struct Frame
+    {
+      double time;
+      std::string path;
+    };
+
+    struct Slot
+    {
+      // Set once map and frame are complete, cleared before they change.
+      // Both threads read the frame, so it is atomic as well.
+      std::atomic<bool> ready{false};
+      std::atomic<size_t> frame{0};
+      std::unique_ptr<SurfaceMap> map;
+    };
+
+    void workerLoop();
+    double wrap(double time) const;
+    size_t frameAt(double time) const;
+    size_t successor(size_t frame) const;
+    bool failed(size_t frame) const;
+    bool fill(Slot & slot, size_t frame);
+    void evict(Slot & slot);
+
+    // Constant while a sequence is open
+    std::vector<Frame> m_frames;
+    bool m_loop;
+
+    Slot m_slots[kFrameSlots];
+
+    // Odd while the real-time thread is inside a read section
+    std::atomic<uint64_t> m_reader_sequence;
+
+    // Where the reader is in the sequence
+    std::atomic<double> m_time;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stop_cv;
+
+    // Guarded by m_mutex
+    std::vector<char> m_failed_frames;
+    std::string m_last_error;
+    bool m_stop;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
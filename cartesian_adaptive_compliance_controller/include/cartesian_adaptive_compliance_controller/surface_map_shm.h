@@ -0,0 +1,68 @@
+#ifndef SURFACE_MAP_SHM_H_INCLUDED
+#define SURFACE_MAP_SHM_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <cstdint>
+#include <string>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Host-wide sharing of surface maps through POSIX shared memory
+ *
+ * A map named \a name lives in two kinds of segments:
+ * - `/<name>` holds the current generation counter.
+ * - `/<name>.<generation>` holds the map image of that generation.
+ *
+ * The publisher writes a new generation completely before bumping the
+ * counter and unlinks the previous segment afterwards. Processes that are
+ * still attached to it keep a valid mapping until they let go, so every
+ * reader always sees a complete and consistent map.
+ *
+ * Several processes may publish under the same name. Each takes a new
+ * generation from an atomic counter in `/<name>`, and the current one only
+ * ever increases, so no two publishers write the same generation and
+ * readers see every swap to the newest map.
+ */
+namespace surface_map_shm
+{
+
+/**
+ * @brief Publish \a map as the next generation under \a name
+ *
+ * If another publisher completes a later generation first, that one stays
+ * current and this one is dropped.
+ *
+ * @param generation The generation that was published
+ *
+ * @return True on success
+ */
+bool publish(const std::string & name, const SurfaceMap & map, uint64_t & generation,
+             std::string & error);
+
+/**
+ * @brief Remove all segments of \a name
+ */
+void unlink(const std::string & name);
+
+/**
+ * @brief The current generation of \a name, or 0 if nothing is published
+ */
+uint64_t currentGeneration(const std::string & name);
+
+/**
+ * @brief Map the current generation of \a name read-only into this process
+ *
+ * The returned map views the shared memory directly and keeps the mapping
+ * alive for as long as it exists.
+ *
+ * @return True on success
+ */
+bool attach(const std::string & name, SurfaceMap & map, std::string & error);
+
+}  // namespace surface_map_shm
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
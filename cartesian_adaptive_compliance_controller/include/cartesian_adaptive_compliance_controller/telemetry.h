@@ -0,0 +1,155 @@
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Registry of the telemetry fields of the adaptive stiffness
+ *
+ * Each entry is FIELD(name, message member, unit, decimation), where the
+ * message member is the AdaptiveStiffnessState field the value goes to and
+ * the decimation is a power of two: the field is recorded every that many
+ * cycles. Everything else about telemetry is generated from this list, so
+ * a field is added in one place.
+ */
+#define ADAPTIVE_STIFFNESS_TELEMETRY(FIELD)                           \
+  FIELD(position_x, position[0], "m", 1)                              \
+  FIELD(position_y, position[1], "m", 1)                              \
+  FIELD(position_z, position[2], "m", 1)                              \
+  FIELD(target_x, target_position[0], "m", 1)                         \
+  FIELD(target_y, target_position[1], "m", 1)                         \
+  FIELD(target_z, target_position[2], "m", 1)                         \
+  FIELD(velocity_x, velocity[0], "m/s", 1)                            \
+  FIELD(velocity_y, velocity[1], "m/s", 1)                            \
+  FIELD(velocity_z, velocity[2], "m/s", 1)                            \
+  FIELD(external_force, external_force, "N", 1)                       \
+  FIELD(sensor_force_x, sensor_force[0], "N", 1)                      \
+  FIELD(sensor_force_y, sensor_force[1], "N", 1)                      \
+  FIELD(sensor_force_z, sensor_force[2], "N", 1)                      \
+  FIELD(reference_force, reference_force, "N", 1)                     \
+  FIELD(min_force, min_force, "N", 1)                                 \
+  FIELD(contact_force, contact_force, "N", 1)                         \
+  FIELD(tank_energy, tank_energy, "J", 1)                             \
+  FIELD(tank_energy_rate, tank_energy_rate, "J", 1)                   \
+  FIELD(tank_energy_threshold, tank_energy_threshold, "J", 256)       \
+  FIELD(power_limit, power_limit, "W", 256)                           \
+  FIELD(stiffness_x, stiffness[0], "N/m", 1)                          \
+  FIELD(stiffness_y, stiffness[1], "N/m", 1)                          \
+  FIELD(stiffness_z, stiffness[2], "N/m", 1)                          \
+  FIELD(max_stiffness_z, max_stiffness_z, "N/m", 256)                 \
+  FIELD(min_stiffness_z, min_stiffness_z, "N/m", 256)                 \
+  FIELD(penetration, penetration, "m", 1)                             \
+  FIELD(max_penetration, max_penetration, "m", 1)                     \
+  FIELD(surface_stiffness, surface_stiffness, "N/m^e", 1)             \
+  FIELD(surface_damping, surface_damping, "Ns/m^(e+1)", 1)            \
+  FIELD(surface_velocity, surface_velocity, "m/s", 1)                 \
+  FIELD(qp_status, qp_status, "", 1)                                  \
+  FIELD(qp_iterations, qp_iterations, "", 1)                          \
+  FIELD(qp_objective, qp_objective, "", 1)                            \
+  FIELD(tank_energy_bound, tank_energy_bound, "W", 1)                 \
+  FIELD(tank_rate_bound, tank_rate_bound, "W", 1)
+
+/**
+ * @brief The telemetry of one control cycle
+ *
+ * Filled in place while the cycle computes its values, and copied out in
+ * a single pass.
+ */
+struct TelemetrySample
+{
+  //! Seconds, from the controller's clock
+  double time = 0.0;
+
+#define TELEMETRY_MEMBER(name, member, unit, decimation) double name = 0.0;
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_MEMBER)
+#undef TELEMETRY_MEMBER
+};
+
+//! Bit of each field in the decimation masks
+struct TelemetryField
+{
+#define TELEMETRY_INDEX(name, member, unit, decimation) name,
+  enum Index : unsigned
+  {
+    ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_INDEX) count
+  };
+#undef TELEMETRY_INDEX
+};
+
+static_assert(TelemetryField::count <= 64, "Decimation masks hold up to 64 fields");
+
+constexpr const char * kTelemetryFieldNames[] = {
+#define TELEMETRY_NAME(name, member, unit, decimation) #name,
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_NAME)
+#undef TELEMETRY_NAME
+};
+
+constexpr const char * kTelemetryFieldUnits[] = {
+#define TELEMETRY_UNIT(name, member, unit, decimation) unit,
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_UNIT)
+#undef TELEMETRY_UNIT
+};
+
+#define TELEMETRY_CHECK(name, member, unit, decimation)                 \
+  static_assert(decimation > 0 && (decimation & (decimation - 1)) == 0, \
+                "Decimation of " #name " must be a power of two");
+ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_CHECK)
+#undef TELEMETRY_CHECK
+
+//! Fields to record in the given cycle
+constexpr uint64_t telemetryMask(uint64_t cycle)
+{
+  uint64_t mask = 0;
+#define TELEMETRY_DUE(name, member, unit, decimation) \
+  if ((cycle & (decimation - 1)) == 0)                \
+  {                                                   \
+    mask |= uint64_t(1) << TelemetryField::name;      \
+  }
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_DUE)
+#undef TELEMETRY_DUE
+  return mask;
+}
+
+constexpr uint64_t kAllTelemetryFields = telemetryMask(0);
+
+/**
+ * @brief Copy the fields in \a mask to their members of \a state
+ *
+ * Real-time safe. Members not in the mask keep their values.
+ *
+ * @tparam StateT An AdaptiveStiffnessState message
+ */
+template <typename StateT>
+void fillTelemetry(const TelemetrySample & sample, uint64_t mask, StateT & state)
+{
+#define TELEMETRY_FILL(name, member, unit, decimation)      \
+  if (mask & (uint64_t(1) << TelemetryField::name))         \
+  {                                                         \
+    state.member = sample.name;                             \
+  }
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_FILL)
+#undef TELEMETRY_FILL
+}
+
+//! Header line of CSV logs, starting with the time
+void writeTelemetryCsvHeader(std::ostream & out);
+
+//! One line of a CSV log
+void writeTelemetryCsvRow(std::ostream & out, const TelemetrySample & sample);
+
+/**
+ * @brief JSON schema of the samples, e.g. for an MCAP channel
+ *
+ * Samples encoded like that are objects of the field names with numbers.
+ */
+std::string telemetryJsonSchema();
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
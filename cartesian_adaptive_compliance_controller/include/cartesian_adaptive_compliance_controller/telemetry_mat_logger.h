@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_MAT_LOGGER_H_INCLUDED
+#define TELEMETRY_MAT_LOGGER_H_INCLUDED
+
+#include <cartesian_adaptive_compliance_controller/telemetry.h>
+
+#include <matlogger2/matlogger2.h>
+#include <matlogger2/utils/mat_appender.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+/**
+ * @brief Logs every telemetry sample to a MATLAB .mat file with matlogger2
+ *
+ * Each field becomes a 1 x N variable of its name, next to `time`. The
+ * real-time thread writes into producer/consumer buffers that are allocated
+ * when logging starts, and matlogger2's appender thread moves them to the
+ * file as they fill. If the disk falls behind by more than a buffer, new
+ * samples are dropped and counted rather than blocking the control loop.
+ */
+class TelemetryMatLogger
+{
+  public:
+    TelemetryMatLogger() = default;
+    ~TelemetryMatLogger();
+
+    TelemetryMatLogger(const TelemetryMatLogger &) = delete;
+    TelemetryMatLogger & operator=(const TelemetryMatLogger &) = delete;
+
+    /**
+     * @brief Start logging to \a path, to which matlogger2 adds a timestamp
+     *
+     * Not while the real-time thread logs.
+     *
+     * @param buffer_size Samples buffered per variable until the appender
+     * thread flushes them. Should hold well over one flush interval.
+     */
+    bool start(const std::string & path, int buffer_size, std::string & error);
+
+    //! Flush what is left and close the file
+    void stop();
+
+    bool isRunning() const { return m_logger != nullptr; }
+
+    //! Real-time safe
+    void log(const TelemetrySample & sample);
+
+    //! Name of the file being written
+    std::string filename() const;
+
+    //! Samples that found the buffers full since start()
+    uint64_t droppedSamples() const { return m_dropped.load(std::memory_order_relaxed); }
+
+  private:
+    XBot::MatLogger2::Ptr m_logger;
+    XBot::MatAppender::Ptr m_appender;
+    std::atomic<uint64_t> m_dropped{0};
+
+    // Built once, so that logging does not allocate strings
+    std::vector<std::string> m_names;
+};
+
+}  // namespace cartesian_adaptive_compliance_controller
+
+#endif
@@ -0,0 +1,95 @@
+// LTTng-UST tracepoint provider of the controller. Included through
+// tracing.h only, and several times over by LTTng itself, hence the guard
+// that lets TRACEPOINT_HEADER_MULTI_READ through.
+
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER cartesian_adaptive_compliance
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "cartesian_adaptive_compliance_controller/tracepoints.h"
+
+#if !defined(TRACEPOINTS_H_INCLUDED) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define TRACEPOINTS_H_INCLUDED
+
+#include <lttng/tracepoint.h>
+
+#include <stdint.h>
+
+// Control cycle, counted from the activation
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, update_start,
+  TP_ARGS(uint64_t, cycle),
+  TP_FIELDS(ctf_integer(uint64_t, cycle, cycle)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, update_end,
+  TP_ARGS(uint64_t, cycle, double, stiffness_z),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_float(double, stiffness_z, stiffness_z)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, compute_stiffness_start,
+  TP_ARGS(uint64_t, cycle, double, tank_energy),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_float(double, tank_energy, tank_energy)))
+
+// The QP status is NaN when the tank was empty and no QP was solved
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, compute_stiffness_end,
+  TP_ARGS(uint64_t, cycle, double, qp_status, double, stiffness_z, double, tank_energy),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_float(double, qp_status, qp_status)
+    ctf_float(double, stiffness_z, stiffness_z)
+    ctf_float(double, tank_energy, tank_energy)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, qp_solve_start,
+  TP_ARGS(uint64_t, cycle),
+  TP_FIELDS(ctf_integer(uint64_t, cycle, cycle)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, qp_solve_end,
+  TP_ARGS(uint64_t, cycle, int, status, int, iterations),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_integer(int, status, status)
+    ctf_integer(int, iterations, iterations)))
+
+// Position in the frame of the surface map
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, map_lookup_start,
+  TP_ARGS(uint64_t, cycle, double, x, double, y),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_float(double, x, x)
+    ctf_float(double, y, y)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, map_lookup_end,
+  TP_ARGS(uint64_t, cycle, double, z, double, stiffness, double, damping),
+  TP_FIELDS(
+    ctf_integer(uint64_t, cycle, cycle)
+    ctf_float(double, z, z)
+    ctf_float(double, stiffness, stiffness)
+    ctf_float(double, damping, damping)))
+
+// Runs in the executor, not in the control cycle, so the message stamp
+// stands in for the cycle counter
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, ft_sensor_wrench_start,
+  TP_ARGS(int32_t, stamp_sec, uint32_t, stamp_nanosec),
+  TP_FIELDS(
+    ctf_integer(int32_t, stamp_sec, stamp_sec)
+    ctf_integer(uint32_t, stamp_nanosec, stamp_nanosec)))
+
+TRACEPOINT_EVENT(
+  cartesian_adaptive_compliance, ft_sensor_wrench_end,
+  TP_ARGS(double, force_z),
+  TP_FIELDS(ctf_float(double, force_z, force_z)))
+
+#endif
+
+#include <lttng/tracepoint-event.h>
@@ -0,0 +1,19 @@
+#ifndef TRACING_H_INCLUDED
+#define TRACING_H_INCLUDED
+
+/**
+ * @brief Emit the tracepoint \a event of the controller's LTTng provider
+ *
+ * The events and their arguments are defined in tracepoints.h. Without
+ * WITH_LTTNG, the macro and the evaluation of its arguments compile out.
+ * A disabled tracepoint in a build with LTTng costs one predicted branch.
+ */
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_TRACING
+#include <cartesian_adaptive_compliance_controller/tracepoints.h>
+#define ADAPTIVE_COMPLIANCE_TRACEPOINT(event, ...) \
+  tracepoint(cartesian_adaptive_compliance, event, __VA_ARGS__)
+#else
+#define ADAPTIVE_COMPLIANCE_TRACEPOINT(event, ...) ((void)0)
+#endif
+
+#endif
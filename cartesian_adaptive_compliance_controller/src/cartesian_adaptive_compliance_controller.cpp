@@ -1,6 +1,14 @@
 #include <cartesian_adaptive_compliance_controller/cartesian_adaptive_compliance_controller.h>
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <cartesian_adaptive_compliance_controller/tracing.h>
 
 #include "cartesian_controller_base/Utility.h"
 #include "controller_interface/controller_interface.hpp"
@@ -9,6 +17,28 @@ using namespace std;
 namespace cartesian_adaptive_compliance_controller
 {
 
+namespace
+{
+// Height above the mapped surface at which the contact starts
+constexpr double kContactOffset = 0.0025;
+
+// Values per message on /adaptive_stiffness_data
+constexpr size_t kLegacyDataFields = 31;
+
+// Least seconds of telemetry the .mat log buffers, for the appender's flushes
+constexpr double kMatLogMinimumBuffering = 1.0;
+
+// Largest tilt of the surface map frame against the base, in rad. The
+// height is taken along the base z axis, which is exact only without tilt.
+constexpr double kMaxSurfaceMapTilt = 0.005;
+
+// Angle between the z axes of a frame with this orientation and its parent
+double tiltOf(const Eigen::Quaterniond & orientation)
+{
+  return std::acos(std::clamp(orientation.toRotationMatrix()(2, 2), -1.0, 1.0));
+}
+}  // namespace
+
 CartesianAdaptiveComplianceController::CartesianAdaptiveComplianceController()
 // Base constructor won't be called in diamond inheritance, so call that
 // explicitly
@@ -29,6 +59,26 @@ CartesianAdaptiveComplianceController::on_init()
   }
 
   auto_declare<std::string>("compliance_ref_link", "");
+  auto_declare<std::string>("surface_map_directory", "/home/robotics/ur3_ros2/matlab/data_body/");
+  auto_declare<std::string>("surface_map_shared_memory", "");
+  auto_declare<bool>("surface_map_quantize", false);
+  auto_declare<std::string>("surface_map_sequence", "");
+  auto_declare<bool>("surface_map_sequence_loop", false);
+  auto_declare<std::string>("surface_map_frame", "");
+  auto_declare<double>("surface_map_frame_timeout", 5.0);
+  auto_declare<bool>("surface_map_learning", false);
+  auto_declare<double>("surface_map_learning_forgetting", 0.995);
+  auto_declare<double>("contact_prediction_horizon", 0.0);
+  auto_declare<std::string>("mat_log_file", "");
+  auto_declare<int>("mat_log_buffer_size", 10000);
+  auto_declare<std::string>("flight_recorder_directory", "");
+  auto_declare<double>("flight_recorder_duration", 10.0);
+  auto_declare<double>("flight_recorder_deadline", 0.0);
+  auto_declare<double>("diagnostics_period", 1.0);
+  auto_declare<double>("period_tolerance", 0.5);
+  auto_declare<double>("minimum_update_interval", 0.0001);
+  auto_declare<bool>("perf_counters", false);
+  auto_declare<bool>("publish_legacy_data", true);
 
   constexpr double default_lin_stiff = 500.0;
   constexpr double default_rot_stiff = 50.0;
@@ -82,11 +132,98 @@ CartesianAdaptiveComplianceController::on_configure(const rclcpp_lifecycle::Stat
   ForceBase::setFtSensorReferenceFrame(m_compliance_ref_link);
 
   m_fk_solver.reset(new KDL::ChainFkSolverVel_recursive(Base::m_robot_chain));
-  old_z = 0.098;
-  // Read data from files
-  dataReader(m_x_coordinates, m_y_coordinates, m_z_values, m_stiffness_values, m_damping_values);
-  cout << m_x_coordinates.size() << " " << m_y_coordinates.size() << " " << m_z_values.size() << " "
-       << m_stiffness_values.size() << " " << m_damping_values.size() << endl;
+
+  // Before the real-time thread starts timing the cycle with it
+  m_latency.calibrate();
+
+  // A time-varying surface replaces the static map. Its frames are
+  // streamed in the background from here on.
+  std::string error;
+  const std::string sequence = get_node()->get_parameter("surface_map_sequence").as_string();
+  if (!sequence.empty())
+  {
+    const bool loop = get_node()->get_parameter("surface_map_sequence_loop").as_bool();
+    if (!m_map_sequence.open(sequence, loop, error))
+    {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Failed to open surface map sequence: "
+                                                      << error);
+      return TYPE::ERROR;
+    }
+    RCLCPP_INFO_STREAM(get_node()->get_logger(), "Streaming surface map sequence " << sequence);
+    m_map_learner.stop();
+
+    // A static map of an earlier configuration may be another workpiece
+    m_map_loader.clear();
+  }
+  else
+  {
+    m_map_sequence.close();
+
+    // Read the initial surface map. Later maps are loaded in the background.
+    // A map in shared memory takes precedence over the directory.
+    const std::string directory =
+      get_node()->get_parameter("surface_map_directory").as_string();
+    const std::string shared =
+      get_node()->get_parameter("surface_map_shared_memory").as_string();
+    m_map_loader.setQuantize(get_node()->get_parameter("surface_map_quantize").as_bool());
+    const rclcpp::Logger logger = get_node()->get_logger();
+    m_map_loader.setErrorHandler([logger](const std::string & error) {
+      RCLCPP_ERROR_STREAM(logger, "Failed to load surface map " << error);
+    });
+    if (!(shared.empty() ? m_map_loader.loadNow(directory, error)
+                         : m_map_loader.attachSharedNow(shared, error)))
+    {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Failed to load surface map: " << error);
+      return TYPE::ERROR;
+    }
+    SurfaceMapLoader::ReadGuard map(m_map_loader);
+    RCLCPP_INFO_STREAM(get_node()->get_logger(), map.get()->source << ": " << map.get()->rows()
+                                                   << " x " << map.get()->cols() << '\n'
+                                                   << map.get()->load_report);
+
+    // Learning starts over with every configuration
+    m_map_learner.stop();
+    if (get_node()->get_parameter("surface_map_learning").as_bool())
+    {
+      const double forgetting =
+        get_node()->get_parameter("surface_map_learning_forgetting").as_double();
+      if (!m_map_learner.start(*map.get(), forgetting))
+      {
+        RCLCPP_ERROR_STREAM(get_node()->get_logger(),
+                            "Surface map learning needs a grid map, not a point cloud");
+        return TYPE::ERROR;
+      }
+    }
+  }
+
+  // The map is defined in its own frame, by default the robot base
+  const std::string map_frame = get_node()->get_parameter("surface_map_frame").as_string();
+  m_base_to_map.initRT(Eigen::Isometry3d::Identity());
+  if (!map_frame.empty() && map_frame != Base::m_robot_base_link &&
+      !lookupSurfaceMapFrame(map_frame, error))
+  {
+    RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Failed to locate surface map frame "
+                                                    << map_frame << ": " << error);
+    return TYPE::ERROR;
+  }
+
+  // Publishing the pose of the map on this topic moves it at runtime, e.g.
+  // after repositioning a fixture
+  m_surface_map_pose_subscriber = get_node()->create_subscription<geometry_msgs::msg::PoseStamped>(
+    get_node()->get_name() + std::string("/surface_map_pose"), 10,
+    std::bind(&CartesianAdaptiveComplianceController::surfaceMapPoseCallback, this,
+              std::placeholders::_1));
+
+  // Publishing a directory on this topic switches the workpiece at runtime.
+  // A sequence has no static map to switch.
+  m_surface_map_subscriber.reset();
+  if (sequence.empty())
+  {
+    m_surface_map_subscriber = get_node()->create_subscription<std_msgs::msg::String>(
+      get_node()->get_name() + std::string("/surface_map_directory"), 10,
+      std::bind(&CartesianAdaptiveComplianceController::surfaceMapCallback, this,
+                std::placeholders::_1));
+  }
   return TYPE::SUCCESS;
 }
 
@@ -108,8 +245,109 @@ CartesianAdaptiveComplianceController::on_activate(const rclcpp_lifecycle::State
       std::bind(&CartesianAdaptiveComplianceController::ftSensorWrenchCallback, this,
                 std::placeholders::_1));
   // Publisher
-  m_data_publisher = get_node()->create_publisher<std_msgs::msg::Float64MultiArray>(
-    std::string("/adaptive_stiffness_data"), 10);
+  m_state_publisher = get_node()->create_publisher<msg::AdaptiveStiffnessState>(
+    std::string("/adaptive_stiffness_state"), 10);
+  m_realtime_state_publisher =
+    std::make_unique<RealtimeLoanedPublisher<msg::AdaptiveStiffnessState>>(m_state_publisher);
+  RCLCPP_INFO_STREAM(get_node()->get_logger(),
+                     "Adaptive stiffness state "
+                       << (m_realtime_state_publisher->loansMessages() ? "loaned from"
+                                                                        : "copied to")
+                       << " the middleware");
+  m_legacy_data_publisher.reset();
+  if (get_node()->get_parameter("publish_legacy_data").as_bool())
+  {
+    RCLCPP_WARN(get_node()->get_logger(),
+                "/adaptive_stiffness_data is deprecated and will be removed in the next "
+                "release, subscribe to /adaptive_stiffness_state instead");
+    m_legacy_data_publisher =
+      std::make_unique<realtime_tools::RealtimePublisher<std_msgs::msg::Float64MultiArray>>(
+        get_node()->create_publisher<std_msgs::msg::Float64MultiArray>(
+          std::string("/adaptive_stiffness_data"), 10));
+    m_legacy_data_publisher->lock();
+    m_legacy_data_publisher->msg_.data.assign(kLegacyDataFields, 0.0);
+    m_legacy_data_publisher->unlock();
+  }
+  m_telemetry_cycle = 0;
+  m_telemetry_pending = kAllTelemetryFields;
+  m_cycle = 0;
+
+  // Full-rate log of the telemetry, one file per activation
+  const std::string mat_log_file = get_node()->get_parameter("mat_log_file").as_string();
+  if (!mat_log_file.empty())
+  {
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_MATLOGGER2
+    std::string error;
+    const int buffer_size =
+      std::max(static_cast<int>(get_node()->get_parameter("mat_log_buffer_size").as_int()),
+               static_cast<int>(std::ceil(nominalUpdateRate() * kMatLogMinimumBuffering)));
+    if (!m_mat_logger.start(mat_log_file, buffer_size, error))
+    {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Failed to start logging to "
+                                                      << mat_log_file << ": " << error);
+      return TYPE::ERROR;
+    }
+    RCLCPP_INFO_STREAM(get_node()->get_logger(),
+                       "Logging telemetry to " << m_mat_logger.filename());
+#else
+    RCLCPP_WARN_STREAM(get_node()->get_logger(),
+                       "Not logging to " << mat_log_file << ", built without matlogger2");
+#endif
+  }
+
+  // Flight recorder, dumping the last seconds of telemetry on faults
+  const std::string recorder_directory =
+    get_node()->get_parameter("flight_recorder_directory").as_string();
+  m_cycle_deadline = get_node()->get_parameter("flight_recorder_deadline").as_double();
+  if (!recorder_directory.empty())
+  {
+    std::string error;
+    const double duration = get_node()->get_parameter("flight_recorder_duration").as_double();
+    const size_t samples = static_cast<size_t>(std::max(duration, 0.0) * nominalUpdateRate());
+    if (!m_flight_recorder.start(recorder_directory, samples, error))
+    {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(),
+                          "Failed to start the flight recorder: " << error);
+      return TYPE::ERROR;
+    }
+    RCLCPP_INFO_STREAM(get_node()->get_logger(), "Flight recorder keeps "
+                                                   << duration << " s in " << recorder_directory);
+  }
+
+  // Periods and compute times of the control loop. Without a configured
+  // deadline, a cycle must finish within the period of the controller manager.
+  const double nominal_period = 1.0 / nominalUpdateRate();
+  m_period_monitor.configure(nominal_period,
+                             get_node()->get_parameter("period_tolerance").as_double(),
+                             m_cycle_deadline > 0.0 ? m_cycle_deadline : nominal_period);
+
+  // Calls of update() closer than this to the last computing one are skipped
+  m_minimum_update_interval = rclcpp::Duration::from_seconds(
+    std::max(get_node()->get_parameter("minimum_update_interval").as_double(), 0.0));
+
+  // Latency of the cycle phases since the last message. The timer runs in
+  // the executor of the controller manager, not in the real-time thread.
+  const double diagnostics_period = get_node()->get_parameter("diagnostics_period").as_double();
+  if (diagnostics_period > 0.0)
+  {
+    m_diagnostics_publisher = get_node()->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+      std::string("/diagnostics"), 10);
+    m_latency.summarize(m_latency_summaries);
+
+    // Opened and summarized by the timer, once the first cycle tells its thread
+    if (get_node()->get_parameter("perf_counters").as_bool())
+    {
+      m_perf_counters.start();
+    }
+    m_diagnostics_timer = get_node()->create_wall_timer(
+      std::chrono::duration<double>(diagnostics_period),
+      std::bind(&CartesianAdaptiveComplianceController::publishDiagnostics, this));
+  }
+  else if (get_node()->get_parameter("perf_counters").as_bool())
+  {
+    RCLCPP_WARN_STREAM(get_node()->get_logger(),
+                       "Not counting hardware events, they are published as diagnostics");
+  }
 
   m_target_pose_publisher = get_node()->create_publisher<geometry_msgs::msg::PoseStamped>(
     get_node()->get_name() + std::string("/target_frame"), 10);
@@ -117,10 +355,31 @@ CartesianAdaptiveComplianceController::on_activate(const rclcpp_lifecycle::State
   m_starting_pose(0) = MotionBase::m_current_frame.p.x();
   m_starting_pose(1) = MotionBase::m_current_frame.p.y();
   m_starting_pose(2) = MotionBase::m_current_frame.p.z();
-  cout << "Starting position: " << m_starting_pose(0) << " " << m_starting_pose(1) << " "
-       << m_starting_pose(2) << endl;
+  RCLCPP_INFO_STREAM(get_node()->get_logger(), "Starting position: " << m_starting_pose(0) << " "
+                                                                    << m_starting_pose(1) << " "
+                                                                    << m_starting_pose(2));
+
+  // Messages from the control loop go through a queue to a thread of their own
+  const rclcpp::Logger logger = get_node()->get_logger();
+  m_realtime_logger.start([logger](LogLevel level, const std::string & text) {
+    switch (level)
+    {
+      case LogLevel::Info:
+        RCLCPP_INFO_STREAM(logger, text);
+        break;
+      case LogLevel::Warn:
+        RCLCPP_WARN_STREAM(logger, text);
+        break;
+      case LogLevel::Error:
+        RCLCPP_ERROR_STREAM(logger, text);
+        break;
+    }
+  });
 
   old_time = current_time = start_time = get_node()->get_clock()->now();
+  m_contact_prediction_horizon =
+    get_node()->get_parameter("contact_prediction_horizon").as_double();
+
   Xt = 1.0;
   dXt = 0.0;
   tank_energy = 0.5 * Xt * Xt;
@@ -136,11 +395,6 @@ CartesianAdaptiveComplianceController::on_activate(const rclcpp_lifecycle::State
 
   x_d_old << m_starting_pose(0), m_starting_pose(1), m_starting_pose(2);
   m_prev_error = ctrl::Vector6D::Zero();
-  for (size_t i = 0; i < 10; i++)
-  {
-    m_surf_vel.push(0.0);
-  }
-  m_surf_vel_sum = 0.0;
 
   return TYPE::SUCCESS;
 }
@@ -154,6 +408,31 @@ CartesianAdaptiveComplianceController::on_deactivate(const rclcpp_lifecycle::Sta
   {
     return TYPE::ERROR;
   }
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_MATLOGGER2
+  m_mat_logger.stop();
+  if (m_mat_logger.droppedSamples() > 0)
+  {
+    RCLCPP_WARN_STREAM(get_node()->get_logger(),
+                       "Telemetry log dropped " << m_mat_logger.droppedSamples()
+                                                << " samples, raise mat_log_buffer_size");
+  }
+#endif
+  m_diagnostics_timer.reset();
+  m_perf_counters.stop();
+  m_realtime_logger.stop();
+  if (m_flight_recorder.isRunning())
+  {
+    RCLCPP_INFO_STREAM(get_node()->get_logger(), "Flight recorder saved "
+                                                   << m_flight_recorder.dumps()
+                                                   << " dumps, the last to "
+                                                   << m_flight_recorder.lastDump());
+    if (!m_flight_recorder.lastError().empty())
+    {
+      RCLCPP_ERROR_STREAM(get_node()->get_logger(),
+                          "Flight recorder: " << m_flight_recorder.lastError());
+    }
+    m_flight_recorder.stop();
+  }
   return TYPE::SUCCESS;
 }
 
@@ -164,16 +443,74 @@ controller_interface::return_type CartesianAdaptiveComplianceController::update(
 controller_interface::return_type CartesianAdaptiveComplianceController::update()
 #endif
 {
+  // The period is that of the controller manager, whether or not this
+  // cycle computes anything
+#if defined CARTESIAN_CONTROLLERS_GALACTIC || defined CARTESIAN_CONTROLLERS_HUMBLE
+  const int64_t update_period = period.nanoseconds();
+#elif defined CARTESIAN_CONTROLLERS_FOXY
+  const auto update_time = std::chrono::steady_clock::now();
+  const int64_t update_period =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(update_time - m_last_update).count();
+  m_last_update = update_time;
+#endif
+  if (m_period_monitor.recordPeriod(update_period))
+  {
+    m_flight_recorder.trigger(Fault::LateCycle);
+  }
+
   current_time = get_node()->get_clock()->now();
-  if (abs((current_time - old_time).nanoseconds()) <
-      rclcpp::Duration::from_seconds(0.0001).nanoseconds())
+  // A call without elapsed time would divide by a zero step
+  const int64_t elapsed = abs((current_time - old_time).nanoseconds());
+  if (elapsed == 0 || elapsed < m_minimum_update_interval.nanoseconds())
   {
+    m_period_monitor.recordSkip();
     return controller_interface::return_type::OK;
   }
+  const auto cycle_start = std::chrono::steady_clock::now();
+  ++m_cycle;
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(update_start, m_cycle);
+
   // Synchronize the internal model and the real robot
+  uint64_t phase_start = m_latency.now();
   Base::m_ik_solver->synchronizeJointPositions(Base::m_joint_state_pos_handles);
+  m_latency.record(LatencyPhase::Synchronize, phase_start);
+
+  // Pin the surface map for this cycle. A map swapped in meanwhile by the
+  // loader is freed on its thread once this guard is gone. The same holds
+  // for the frames of a time-varying surface.
+  SurfaceMapLoader::ReadGuard surface_map(m_map_loader);
+  SurfaceMapSequence::ReadGuard surface_frames(m_map_sequence,
+                                               (current_time - start_time).seconds());
+  if (m_map_sequence.isOpen())
+  {
+    m_surface_frames = surface_frames.get();
+  }
+  else
+  {
+    m_surface_frames = SurfaceFrames();
+    m_surface_frames.current = surface_map.get();
+  }
+  if (m_surface_frames.current == nullptr)
+  {
+    // No frame of the sequence is loaded yet. A static map is not used
+    // meanwhile, it may be another workpiece. The robot holds its last
+    // command.
+    m_period_monitor.recordSkip();
+    m_realtime_logger.log(LogMessage::NoSurfaceMap);
+    ADAPTIVE_COMPLIANCE_TRACEPOINT(update_end, m_cycle, std::numeric_limits<double>::quiet_NaN());
+    return controller_interface::return_type::OK;
+  }
 
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(compute_stiffness_start, m_cycle, tank_energy);
+  m_perf_counters.begin(PerfSection::ComputeStiffness);
   ctrl::Vector6D tmp = CartesianAdaptiveComplianceController::computeStiffness();
+  m_perf_counters.end(PerfSection::ComputeStiffness);
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(compute_stiffness_end, m_cycle, m_telemetry.qp_status, tmp[2],
+                                 tank_energy);
+  if (!tmp.allFinite())
+  {
+    m_flight_recorder.trigger(Fault::NonFiniteStiffness);
+  }
   tmp[3] = get_node()->get_parameter("stiffness.rot_x").as_double();
   tmp[4] = get_node()->get_parameter("stiffness.rot_y").as_double();
   tmp[5] = get_node()->get_parameter("stiffness.rot_z").as_double();
@@ -183,6 +520,7 @@ controller_interface::return_type CartesianAdaptiveComplianceController::update(
 
   // Control the robot motion in such a way that the resulting net force
   // vanishes. This internal control needs some simulation time steps.
+  phase_start = m_latency.now();
   for (int i = 0; i < Base::m_iterations; ++i)
   {
     // The internal 'simulation time' is deliberately independent of the outer
@@ -198,8 +536,21 @@ controller_interface::return_type CartesianAdaptiveComplianceController::update(
   // publish target frame
   // publishTargetFrame();
 
+  phase_start = m_latency.record(LatencyPhase::ComplianceIterations, phase_start);
+
   // Write final commands to the hardware interface
   Base::writeJointControlCmds();
+  m_latency.record(LatencyPhase::WriteCommands, phase_start);
+
+  const int64_t compute_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - cycle_start)
+                                 .count();
+  if (m_period_monitor.recordComputeTime(compute_time))
+  {
+    m_flight_recorder.trigger(Fault::DeadlineOverrun);
+  }
+
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(update_end, m_cycle, m_stiffness(2, 2));
   old_time = current_time;
   x_d_old << MotionBase::m_target_frame.p.x(), MotionBase::m_target_frame.p.y(),
     MotionBase::m_target_frame.p.z();
@@ -252,6 +603,8 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeComplianceError()
 void CartesianAdaptiveComplianceController::ftSensorWrenchCallback(
   const geometry_msgs::msg::WrenchStamped::SharedPtr wrench)
 {
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(ft_sensor_wrench_start, wrench->header.stamp.sec,
+                                 wrench->header.stamp.nanosec);
   KDL::Wrench tmp;
   tmp[0] = wrench->wrench.force.x;
   tmp[1] = wrench->wrench.force.y;
@@ -260,12 +613,86 @@ void CartesianAdaptiveComplianceController::ftSensorWrenchCallback(
   m_ft_sensor_wrench(0) = tmp[0];
   m_ft_sensor_wrench(1) = tmp[1];
   m_ft_sensor_wrench(2) = tmp[2];
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(ft_sensor_wrench_end, tmp[2]);
+}
+
+void CartesianAdaptiveComplianceController::surfaceMapCallback(
+  const std_msgs::msg::String::SharedPtr directory)
+{
+  RCLCPP_INFO_STREAM(get_node()->get_logger(), "Loading surface map from " << directory->data);
+  m_map_loader.requestLoad(directory->data);
+}
+
+bool CartesianAdaptiveComplianceController::lookupSurfaceMapFrame(const std::string & frame,
+                                                                  std::string & error)
+{
+  // The listener is only needed for this one lookup
+  tf2_ros::Buffer buffer(get_node()->get_clock());
+  tf2_ros::TransformListener listener(buffer);
+  const double timeout = get_node()->get_parameter("surface_map_frame_timeout").as_double();
+  geometry_msgs::msg::TransformStamped map_to_base;
+  try
+  {
+    map_to_base = buffer.lookupTransform(Base::m_robot_base_link, frame, tf2::TimePointZero,
+                                         tf2::durationFromSec(timeout));
+  }
+  catch (const tf2::TransformException & exception)
+  {
+    error = exception.what();
+    return false;
+  }
+
+  const auto & t = map_to_base.transform.translation;
+  const auto & q = map_to_base.transform.rotation;
+  const Eigen::Quaterniond orientation = Eigen::Quaterniond(q.w, q.x, q.y, q.z).normalized();
+  const double tilt = tiltOf(orientation);
+  if (tilt > kMaxSurfaceMapTilt)
+  {
+    error = "tilted by " + std::to_string(tilt) + " rad, only rotations about z are supported";
+    return false;
+  }
+  Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+  pose.translate(Eigen::Vector3d(t.x, t.y, t.z));
+  pose.rotate(orientation);
+  m_base_to_map.initRT(pose.inverse());
+  RCLCPP_INFO_STREAM(get_node()->get_logger(),
+                     "Surface map frame " << frame << " at " << t.x << " " << t.y << " " << t.z);
+  return true;
+}
+
+void CartesianAdaptiveComplianceController::surfaceMapPoseCallback(
+  const geometry_msgs::msg::PoseStamped::SharedPtr pose)
+{
+  if (!pose->header.frame_id.empty() && pose->header.frame_id != Base::m_robot_base_link)
+  {
+    RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Surface map pose must be given in "
+                                                    << Base::m_robot_base_link << ", not "
+                                                    << pose->header.frame_id);
+    return;
+  }
+  const auto & p = pose->pose.position;
+  const auto & q = pose->pose.orientation;
+  const Eigen::Quaterniond orientation = Eigen::Quaterniond(q.w, q.x, q.y, q.z).normalized();
+  const double tilt = tiltOf(orientation);
+  if (tilt > kMaxSurfaceMapTilt)
+  {
+    RCLCPP_ERROR_STREAM(get_node()->get_logger(),
+                        "Ignoring surface map pose tilted by "
+                          << tilt << " rad, only rotations about z are supported");
+    return;
+  }
+  Eigen::Isometry3d map_to_base = Eigen::Isometry3d::Identity();
+  map_to_base.translate(Eigen::Vector3d(p.x, p.y, p.z));
+  map_to_base.rotate(orientation);
+  m_base_to_map.writeFromNonRT(map_to_base.inverse());
 }
 
 ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
 {
   USING_NAMESPACE_QPOASES
+  uint64_t phase_start = m_latency.now();
   getEndEffectorPoseReal();
+  m_latency.record(LatencyPhase::EndEffectorPose, phase_start);
 
   rclcpp::Duration deltaT_ros = current_time - old_time;
 
@@ -289,24 +716,58 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
   ctrl::Vector3D velocity_error;
   velocity_error << -m_x_dot(0), -m_x_dot(1), -m_x_dot(2);
 
-  // Get the position of the data corresponding to the current position
-  int x_index = findClosestIndex(m_x_coordinates, x(0));
-  int y_index = findClosestIndex(m_y_coordinates, x(1));
+  // Get the z, stiffness and damping values corresponding to the current position.
+  // Detail that the end effector passes within one cycle would be aliased,
+  // so grids are looked up on a coarser level of the map when moving fast.
+  // Outside of a point cloud's coverage there is no surface to touch, and
+  // the end effector moves freely, as above the surface.
+  // The map is looked up in its own frame. Its height is taken back along
+  // the base z axis, which is exact as long as the map is only shifted and
+  // turned about the vertical.
+  const Eigen::Isometry3d & base_to_map = *m_base_to_map.readFromRT();
+  const ctrl::Vector3D x_map = base_to_map * x;
+  const ctrl::Vector3D x_dot_map = base_to_map.linear() * m_x_dot;
+  const double travel = std::hypot(x_dot_map(0), x_dot_map(1)) * m_deltaT;
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(map_lookup_start, m_cycle, x_map(0), x_map(1));
+  m_perf_counters.begin(PerfSection::MapLookup);
+  phase_start = m_latency.now();
+  const bool covered = sampleSurface(m_surface_frames, x_map(0), x_map(1), travel,
+                                     m_surface_cursor, m_surface_sample);
+  m_latency.record(LatencyPhase::MapLookup, phase_start);
+  m_perf_counters.end(PerfSection::MapLookup);
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(map_lookup_end, m_cycle, m_surface_sample.z,
+                                 m_surface_sample.stiffness, m_surface_sample.damping);
+  double z_value = x(2) + (m_surface_sample.z - x_map(2));
+  double stiffness_value = m_surface_sample.stiffness;
+  double damping_value = m_surface_sample.damping;
+
+  // Maps with material IDs carry the whole contact model of each cell
+  double exponent = 1.35;
+  double min_force = -9;
+  if (m_surface_sample.material)
+  {
+    exponent = m_surface_sample.material->exponent;
+    max_pen = m_surface_sample.material->max_penetration;
+    min_force = m_surface_sample.material->min_force;
+  }
 
-  // Get the z, stiffness and damping values corresponding to the current position
-  double z_value = m_z_values[x_index][y_index];
-  double stiffness_value = m_stiffness_values[x_index][y_index];
-  double damping_value = m_damping_values[x_index][y_index];
+  // Cells learned from the contact forces override the map. Learning pauses
+  // while a map of another grid is in use.
+  const bool learning = m_map_learner.matches(*m_surface_frames.current);
+  double learned_height = 0.0;
+  if (learning)
+  {
+    m_map_learner.applyUpdates();
+    m_map_learner.correct(x_map(0), x_map(1), learned_height, stiffness_value, damping_value);
+    z_value += learned_height;
+  }
 
-  m_surf_vel_sum -= m_surf_vel.front();
-  m_surf_vel.pop();
-  double sv = (z_value - old_z) / m_deltaT;
-  m_surf_vel.push(sv);
-  m_surf_vel_sum += sv;
-  old_z = z_value;
+  // Vertical velocity of the surface under the end effector:
+  // dz/dt = grad(z) . xdot, plus the motion of a time-varying surface itself
+  double surf_vel = m_surface_sample.dz_dx * x_dot_map(0) +
+                    m_surface_sample.dz_dy * x_dot_map(1) + m_surface_sample.dz_dt;
 
-  // mean of the last 5 values
-  double surf_vel = m_surf_vel_sum / m_surf_vel.size();
+  const double penetration = z_value + kContactOffset - x(2);
 
   // retrieve current velocity
   ctrl::Vector6D xdot = Base::m_ik_solver->getEndEffectorVel();
@@ -325,8 +786,52 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
   // F_ref
   ctrl::Vector3D F_ref = {0.0, 0.0, 0.0};
 
+  // Predict the contact from the distance to the surface and the closing
+  // speed, so that the stiffness adapts before the sensor feels the impact.
+  // The contact itself happens kContactOffset above the surface, as for the penetration.
+  m_surface_distance = std::numeric_limits<double>::infinity();
+  m_time_to_contact = std::numeric_limits<double>::infinity();
+  if (m_surface_frames.current->distance_field)
+  {
+    double gradient[3];
+    m_surface_frames.current->distance_field->query(x_map.data(), m_surface_distance, gradient);
+    double closing_speed = -(gradient[0] * x_dot_map(0) + gradient[1] * x_dot_map(1) +
+                             gradient[2] * x_dot_map(2));
+    double gap = std::max(m_surface_distance - kContactOffset, 0.0);
+    if (gap == 0.0)
+    {
+      m_time_to_contact = 0.0;
+    }
+    else if (closing_speed > 0.0)
+    {
+      m_time_to_contact = gap / closing_speed;
+    }
+  }
+  bool contact_predicted = m_time_to_contact < m_contact_prediction_horizon;
+
+  // Maps with a material volume describe the response over depth directly
+  // in secant coefficients, the others follow the power law of the material.
+  // The force at the current penetration and the reference force follow the
+  // same model.
+  const MaterialVolume * volume =
+    covered ? m_surface_frames.current->material_volume.get() : nullptr;
+  double volume_stiffness = 0.0;
+  double volume_damping = 0.0;
+  const bool volume_model =
+    volume && volume->sample(x_map(0), x_map(1), penetration, volume_stiffness, volume_damping);
+  double contact_force = 0.0;
+  if (volume_model)
+  {
+    contact_force = (volume_stiffness - volume_damping * (m_x_dot(2) - surf_vel)) * penetration;
+  }
+  else if (covered)
+  {
+    contact_force =
+      (stiffness_value - damping_value * (m_x_dot(2) - surf_vel)) * pow(penetration, exponent);
+  }
+
   // if (x(2) < z_value + 0.0025)
-  if (m_ft_sensor_wrench(2) < -0.5)
+  if (covered && (m_ft_sensor_wrench(2) < -0.5 || contact_predicted))
   {
     // penetrating material
     // l(2) = x(2);
@@ -336,9 +841,33 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
     // F_min(2) = -( stiffness_value * pow(max_pen,1.35) - damping_value * pow(max_pen,1.35) * (m_x_dot(2)-surf_vel) );
     // F_ref(2) = -9;
     // F_min(2) = -( stiffness_value * pow(max_pen,1.35) - damping_value * pow(max_pen,1.35) * (m_x_dot(2)-surf_vel) );
-    F_ref(2) = -(stiffness_value * pow(max_pen, 1.35) -
-                 damping_value * pow(max_pen, 1.35) * (m_x_dot(2) - surf_vel));
-    F_min(2) = -9;
+    if (volume_model &&
+        volume->sample(x_map(0), x_map(1), max_pen, stiffness_value, damping_value))
+    {
+      F_ref(2) = -(stiffness_value * max_pen -
+                   damping_value * max_pen * (m_x_dot(2) - surf_vel));
+    }
+    else
+    {
+      F_ref(2) = -(stiffness_value * pow(max_pen, exponent) -
+                   damping_value * pow(max_pen, exponent) * (m_x_dot(2) - surf_vel));
+
+      // Only sensed contact tells anything about the material
+      if (learning && m_ft_sensor_wrench(2) < -0.5)
+      {
+        ContactObservation observation;
+        observation.x = x_map(0);
+        observation.y = x_map(1);
+        observation.penetration = penetration - learned_height;
+        observation.velocity = m_x_dot(2) - surf_vel;
+        observation.force = -m_ft_sensor_wrench(2);
+        observation.stiffness = m_surface_sample.stiffness;
+        observation.damping = m_surface_sample.damping;
+        observation.exponent = exponent;
+        m_map_learner.observe(observation);
+      }
+    }
+    F_min(2) = min_force;
   }
   else
   {
@@ -350,6 +879,38 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
     F_min(2) = -F_max(2);
   }
 
+  // Telemetry of this cycle, completed by publishTelemetry() on the way out
+  m_telemetry.time = current_time.seconds();
+  m_telemetry.position_x = x(0);
+  m_telemetry.position_y = x(1);
+  m_telemetry.position_z = x(2);
+  m_telemetry.target_x = x_d(0);
+  m_telemetry.target_y = x_d(1);
+  m_telemetry.target_z = x_d(2);
+  m_telemetry.velocity_x = m_x_dot(0);
+  m_telemetry.velocity_y = m_x_dot(1);
+  m_telemetry.velocity_z = m_x_dot(2);
+  m_telemetry.sensor_force_x = m_ft_sensor_wrench(0);
+  m_telemetry.sensor_force_y = m_ft_sensor_wrench(1);
+  m_telemetry.sensor_force_z = m_ft_sensor_wrench(2);
+  m_telemetry.reference_force = F_ref(2);
+  m_telemetry.min_force = F_min(2);
+  m_telemetry.contact_force = contact_force;
+  m_telemetry.tank_energy_threshold = tank_energy_threshold;
+  m_telemetry.power_limit = power_limit;
+  m_telemetry.max_stiffness_z = kd_max(2);
+  m_telemetry.min_stiffness_z = kd_min(2);
+  m_telemetry.penetration = penetration;
+  m_telemetry.max_penetration = max_pen;
+  m_telemetry.surface_stiffness = stiffness_value;
+  m_telemetry.surface_damping = damping_value;
+  m_telemetry.surface_velocity = surf_vel;
+  m_telemetry.qp_status = std::numeric_limits<double>::quiet_NaN();
+  m_telemetry.qp_iterations = std::numeric_limits<double>::quiet_NaN();
+  m_telemetry.qp_objective = std::numeric_limits<double>::quiet_NaN();
+  m_telemetry.tank_energy_bound = std::numeric_limits<double>::quiet_NaN();
+  m_telemetry.tank_rate_bound = std::numeric_limits<double>::quiet_NaN();
+
   if (tank_energy >= 1.0)
   {
     m_sigma = 0.0;
@@ -408,46 +969,13 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
   if (tank_energy < tank_energy_threshold)
   {
     // empty tank
-    cout << "empty tank" << endl;
+    m_realtime_logger.log(LogMessage::EmptyTank);
+    m_flight_recorder.trigger(Fault::EmptyTank);
     stiffness << kd_min(0), kd_min(1), kd_min(2), 50.0, 50.0, 50.0;
     tank_energy =
       tank_energy_threshold + energy_var_damping * m_deltaT;  // + (energy_var_stiff)*m_deltaT;
     // old_tank_energy = tank_energy;
-    std_msgs::msg::Float64MultiArray m_data_msg;
-    m_data_msg.data = {
-      (current_time.nanoseconds() * 1e-9),                                      // Time
-      x(0),                                                                     // x ee
-      x(1),                                                                     // y ee
-      x(2),                                                                     // z ee
-      x_d(0),                                                                   // x_d ee
-      x_d(1),                                                                   // y_d ee
-      x_d(2),                                                                   // z_d ee
-      kd(2) * position_error(2) + 2 * 0.707 * sqrt(kd(2)) * velocity_error(2),  // F_ext
-      m_ft_sensor_wrench(0),                                                    // F_ft
-      m_ft_sensor_wrench(1),                                                    // F_ft
-      m_ft_sensor_wrench(2),                                                    // F_ft
-      F_ref(2),                                                                 // F_ref
-      tank_energy,                                                              // Tank
-      (energy_var_stiff + energy_var_damping) * m_deltaT,                       // Tank_dot
-      kd(0),                                                                    // Kd_x
-      kd(1),                                                                    // Kd_y
-      kd(2),                                                                    // Kd_z
-      kd_max(2),                                                                // Kd_z max
-      kd_min(2),                                                                // Kd_z min
-      (z_value + 0.0025 - x(2)),                                                // penetration
-      stiffness_value,                                                          // K_surf
-      damping_value,                                                            // D_surf
-      F_min(2),                                                                 // F_min
-      (stiffness_value * pow((z_value + 0.0025 - x(2)), 1.35) -
-       damping_value * pow((z_value + 0.0025 - x(2)), 1.35) * (m_x_dot(2) - surf_vel)),
-      max_pen,
-      tank_energy_threshold,
-      power_limit,
-      m_x_dot(0),
-      m_x_dot(1),
-      m_x_dot(2),
-      surf_vel};
-    m_data_publisher->publish(m_data_msg);
+    publishTelemetry();
     return stiffness;
   }
   else
@@ -489,53 +1017,30 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
   options.printLevel = PL_NONE;
   // redeclare solver with options
   min_problem.setOptions(options);
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(qp_solve_start, m_cycle);
+  phase_start = m_latency.now();
   ret_val = getSimpleStatus(min_problem.init(H, g, A, lb, ub, lbA, ubA, nWSR));
+  m_latency.record(LatencyPhase::QpSolve, phase_start);
+  ADAPTIVE_COMPLIANCE_TRACEPOINT(qp_solve_end, m_cycle, static_cast<int>(ret_val),
+                                 static_cast<int>(nWSR));
   real_t xOpt[3];
 
   min_problem.getPrimalSolution(xOpt);
+  m_telemetry.qp_status = ret_val;
+  m_telemetry.qp_iterations = nWSR;
+  m_telemetry.qp_objective = min_problem.getObjVal();
+  m_telemetry.tank_energy_bound = T_constr_min;
+  m_telemetry.tank_rate_bound = T_dot_min;
 
   if (ret_val != SUCCESSFUL_RETURN)
   {
-    cout << "QP solver error: " << ret_val << endl;
+    m_realtime_logger.log(LogMessage::QpError, ret_val);
+    m_flight_recorder.trigger(Fault::QpError);
 
     stiffness << kd_min(0), kd_min(1), kd_min(2), 50.0, 50.0, 50.0;
     tank_energy += energy_var_damping * m_deltaT;  // + (energy_var_stiff)*m_deltaT;
     // old_tank_energy = tank_energy;
-    std_msgs::msg::Float64MultiArray m_data_msg;
-    m_data_msg.data = {
-      (current_time.nanoseconds() * 1e-9),                                      // Time
-      x(0),                                                                     // x ee
-      x(1),                                                                     // y ee
-      x(2),                                                                     // z ee
-      x_d(0),                                                                   // x_d ee
-      x_d(1),                                                                   // y_d ee
-      x_d(2),                                                                   // z_d ee
-      kd(2) * position_error(2) + 2 * 0.707 * sqrt(kd(2)) * velocity_error(2),  // F_ext
-      m_ft_sensor_wrench(0),                                                    // F_ft
-      m_ft_sensor_wrench(1),                                                    // F_ft
-      m_ft_sensor_wrench(2),                                                    // F_ft
-      F_ref(2),                                                                 // F_ref
-      tank_energy,                                                              // Tank
-      (energy_var_stiff + energy_var_damping) * m_deltaT,                       // Tank_dot
-      kd(0),                                                                    // Kd_x
-      kd(1),                                                                    // Kd_y
-      kd(2),                                                                    // Kd_z
-      kd_max(2),                                                                // Kd_z max
-      kd_min(2),                                                                // Kd_z min
-      (z_value + 0.0025 - x(2)),                                                // penetration
-      stiffness_value,                                                          // K_surf
-      damping_value,                                                            // D_surf
-      F_min(2),                                                                 // F_min
-      (stiffness_value * pow((z_value + 0.0025 - x(2)), 1.35) -
-       damping_value * pow((z_value + 0.0025 - x(2)), 1.35) * (m_x_dot(2) - surf_vel)),
-      max_pen,
-      tank_energy_threshold,
-      power_limit,
-      m_x_dot(0),
-      m_x_dot(1),
-      m_x_dot(2),
-      surf_vel};
-    m_data_publisher->publish(m_data_msg);
+    publishTelemetry();
     return stiffness;
   }
 
@@ -550,64 +1055,197 @@ ctrl::Vector6D CartesianAdaptiveComplianceController::computeStiffness()
   print_index++;
   if (print_index % 21 == 0)
   {
-    cout << "#########################################################" << endl;
-    cout << " z_pos : " << x(2) << " | des " << x_d(2) << " | surf: " << z_value
-         << " | surf vel: " << surf_vel << endl;
-    cout << "EE velocity: " << velocity_error(2) << " | ik vel" << xdot(2) << endl;
     // cout<<" KD-KMIN: "<<endl<< (kd-kd_min)<<endl;
     // cout << "deltaX_ext: " << position_error(2) << "  | deltaX_dot: " << velocity_error(2) << endl;
-    cout << "Kd: " << kd(0) << " " << kd(1) << " " << kd(2) << endl;
-    cout << "Tank: " << tank_energy
-         << " | Tank_dot: " << (energy_var_stiff + energy_var_damping) * m_deltaT
-         << " |  threshold: " << T_constr_min << endl;
-    cout << "F_ext: " << kd(2) * position_error(2) + 2 * 0.707 * sqrt(kd(2)) * velocity_error(2)
-         << "|  F_des: " << F_ref(2) << "|  F_min: " << F_min(2)
-         << " | F_ft: " << m_ft_sensor_wrench(2) << endl;
-    cout << "Stiffness: " << stiffness_value << " | Damping: " << damping_value << endl;
-    cout << "deltaT " << m_deltaT << endl;
     // cout<< "X: "<< x(2) <<endl;
+    m_realtime_logger.log(
+      LogMessage::CycleReport, x(2), x_d(2), z_value, surf_vel, velocity_error(2), xdot(2), kd(0),
+      kd(1), kd(2), tank_energy, (energy_var_stiff + energy_var_damping) * m_deltaT, T_constr_min,
+      kd(2) * position_error(2) + 2 * 0.707 * sqrt(kd(2)) * velocity_error(2), F_ref(2), F_min(2),
+      m_ft_sensor_wrench(2), stiffness_value, damping_value, m_deltaT);
   }
 
-  std_msgs::msg::Float64MultiArray m_data_msg;
-  m_data_msg.data = {
-    (current_time.nanoseconds() * 1e-9),                                      // Time
-    x(0),                                                                     // x ee
-    x(1),                                                                     // y ee
-    x(2),                                                                     // z ee
-    x_d(0),                                                                   // x_d ee
-    x_d(1),                                                                   // y_d ee
-    x_d(2),                                                                   // z_d ee
-    kd(2) * position_error(2) + 2 * 0.707 * sqrt(kd(2)) * velocity_error(2),  // F_ext
-    m_ft_sensor_wrench(0),                                                    // F_ft
-    m_ft_sensor_wrench(1),                                                    // F_ft
-    m_ft_sensor_wrench(2),                                                    // F_ft
-    F_ref(2),                                                                 // F_ref
-    tank_energy,                                                              // Tank
-    (energy_var_stiff + energy_var_damping) * m_deltaT,                       // Tank_dot
-    kd(0),                                                                    // Kd_x
-    kd(1),                                                                    // Kd_y
-    kd(2),                                                                    // Kd_z
-    kd_max(2),                                                                // Kd_z max
-    kd_min(2),                                                                // Kd_z min
-    (z_value + 0.0025 - x(2)),                                                // penetration
-    stiffness_value,                                                          // K_surf
-    damping_value,                                                            // D_surf
-    F_min(2),                                                                 // F_min
-    (stiffness_value * pow((z_value + 0.0025 - x(2)), 1.35) -
-     damping_value * pow((z_value + 0.0025 - x(2)), 1.35) * (m_x_dot(2) - surf_vel)),
-    max_pen,
-    tank_energy_threshold,
-    power_limit,
-    m_x_dot(0),
-    m_x_dot(1),
-    m_x_dot(2),
-    surf_vel};
-  m_data_publisher->publish(m_data_msg);
+  publishTelemetry();
 
   //old_tank_energy = tank_energy;
   return stiffness;
 }
 
+void CartesianAdaptiveComplianceController::publishTelemetry()
+{
+  // The values that computeStiffness() changes after filling in the rest
+  m_telemetry.tank_energy = tank_energy;
+  m_telemetry.tank_energy_rate = (energy_var_stiff + energy_var_damping) * m_deltaT;
+  m_telemetry.stiffness_x = kd(0);
+  m_telemetry.stiffness_y = kd(1);
+  m_telemetry.stiffness_z = kd(2);
+  m_telemetry.external_force =
+    kd(2) * (m_telemetry.target_z - m_telemetry.position_z) -
+    2 * 0.707 * sqrt(kd(2)) * m_telemetry.velocity_z;
+
+#ifdef CARTESIAN_ADAPTIVE_COMPLIANCE_MATLOGGER2
+  if (m_mat_logger.isRunning())
+  {
+    m_mat_logger.log(m_telemetry);
+  }
+#endif
+
+  m_flight_recorder.record(m_telemetry);
+
+  // The deprecated topic has a publisher of its own, busy or not
+  publishLegacyData();
+
+  // Decimated fields that come due while the publisher is busy are copied
+  // with the next sample that gets through. Skip this cycle's sample rather
+  // than wait for the publisher thread.
+  m_telemetry_pending |= telemetryMask(m_telemetry_cycle++);
+  msg::AdaptiveStiffnessState * state = m_realtime_state_publisher->tryAcquire();
+  if (!state)
+  {
+    return;
+  }
+  state->stamp = current_time;
+  fillTelemetry(m_telemetry, m_telemetry_pending, *state);
+  m_telemetry_pending = 0;
+  m_realtime_state_publisher->publish();
+}
+
+void CartesianAdaptiveComplianceController::publishLegacyData()
+{
+  // Same order as before the typed state. The message is sized on
+  // activation, so nothing is allocated here.
+  if (!m_legacy_data_publisher || !m_legacy_data_publisher->trylock())
+  {
+    return;
+  }
+  const TelemetrySample & t = m_telemetry;
+  const double data[kLegacyDataFields] = {
+    t.time, t.position_x, t.position_y, t.position_z, t.target_x, t.target_y, t.target_z,
+    t.external_force, t.sensor_force_x, t.sensor_force_y, t.sensor_force_z, t.reference_force,
+    t.tank_energy, t.tank_energy_rate, t.stiffness_x, t.stiffness_y, t.stiffness_z,
+    t.max_stiffness_z, t.min_stiffness_z, t.penetration, t.surface_stiffness, t.surface_damping,
+    t.min_force, t.contact_force, t.max_penetration, t.tank_energy_threshold, t.power_limit,
+    t.velocity_x, t.velocity_y, t.velocity_z, t.surface_velocity};
+  std::copy(data, data + kLegacyDataFields, m_legacy_data_publisher->msg_.data.begin());
+  m_legacy_data_publisher->unlockAndPublish();
+}
+
+void CartesianAdaptiveComplianceController::publishDiagnostics()
+{
+  m_latency.summarize(m_latency_summaries);
+
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.name = get_node()->get_name() + std::string(": cycle latency");
+  status.message = m_latency.usesTsc() ? "timed with the TSC" : "timed with steady_clock";
+  auto add = [&status](const std::string & key, const std::string & value) {
+    diagnostic_msgs::msg::KeyValue pair;
+    pair.key = key;
+    pair.value = value;
+    status.values.push_back(pair);
+  };
+  // Microseconds, within the 3 % of the histogram buckets
+  auto microseconds = [](uint64_t nanoseconds) { return std::to_string(nanoseconds * 1e-3); };
+  for (size_t i = 0; i < kLatencyPhases; ++i)
+  {
+    const std::string phase = latencyPhaseName(static_cast<LatencyPhase>(i));
+    const LatencySummary & summary = m_latency_summaries[i];
+    add(phase + " samples", std::to_string(summary.samples));
+    add(phase + " p50 [us]", microseconds(summary.p50));
+    add(phase + " p99 [us]", microseconds(summary.p99));
+    add(phase + " p99.9 [us]", microseconds(summary.p999));
+    add(phase + " max [us]", microseconds(summary.max));
+  }
+
+  diagnostic_msgs::msg::DiagnosticArray array;
+  array.header.stamp = get_node()->get_clock()->now();
+  array.status.push_back(status);
+
+  // Period and load of the loop, a warning if it was late or overran
+  m_period_monitor.summarize(m_period_summary);
+  const PeriodSummary & summary = m_period_summary;
+  status = diagnostic_msgs::msg::DiagnosticStatus();
+  status.name = get_node()->get_name() + std::string(": control period");
+  if (summary.late > 0 || summary.overruns > 0)
+  {
+    status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+    status.message = std::to_string(summary.late) + " late cycles, " +
+                     std::to_string(summary.overruns) + " overruns";
+  }
+  else
+  {
+    status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status.message = "on time";
+  }
+  add("nominal period [us]", microseconds(summary.nominal_period));
+  add("deadline [us]", microseconds(summary.deadline));
+  add("updates", std::to_string(summary.updates));
+  add("skipped updates", std::to_string(summary.skipped));
+  add("late cycles", std::to_string(summary.late));
+  add("overruns", std::to_string(summary.overruns));
+  add("period p50 [us]", microseconds(summary.period_p50));
+  add("period p99.9 [us]", microseconds(summary.period_p999));
+  add("period max [us]", microseconds(summary.period_max));
+  add("jitter p99.9 [us]", microseconds(summary.jitter_p999));
+  add("jitter max [us]", microseconds(summary.jitter_max));
+  add("compute time p50 [us]", microseconds(summary.compute_p50));
+  add("compute time p99.9 [us]", microseconds(summary.compute_p999));
+  add("compute time max [us]", microseconds(summary.compute_max));
+  add("load p99.9", std::to_string(summary.load_p999));
+  add("load max", std::to_string(summary.load_max));
+  array.status.push_back(status);
+
+  // Mean hardware event counts per call of the measured sections
+  if (m_perf_counters.isStarted())
+  {
+    std::string error;
+    status = diagnostic_msgs::msg::DiagnosticStatus();
+    status.name = get_node()->get_name() + std::string(": performance counters");
+    status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    const bool failed_before = m_perf_counters.hasFailed();
+    if (!m_perf_counters.open(error))
+    {
+      // Logged once, the status keeps reporting it
+      if (!failed_before)
+      {
+        RCLCPP_ERROR_STREAM(get_node()->get_logger(), "Performance counters: " << error);
+      }
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::ERROR;
+      status.message = error;
+    }
+    m_perf_counters.summarize(m_perf_summaries);
+    for (size_t i = 0; i < kPerfSections; ++i)
+    {
+      const std::string section = perfSectionName(static_cast<PerfSection>(i));
+      const PerfSummary & summary = m_perf_summaries[i];
+      add(section + " samples", std::to_string(summary.samples));
+      for (size_t e = 0; e < kPerfEvents; ++e)
+      {
+        add(section + " " + perfEventName(static_cast<PerfEvent>(e)),
+            std::to_string(summary.per_sample[e]));
+      }
+      const double cycles = summary.per_sample[static_cast<size_t>(PerfEvent::Cycles)];
+      const double instructions =
+        summary.per_sample[static_cast<size_t>(PerfEvent::Instructions)];
+      add(section + " instructions per cycle", std::to_string(instructions / cycles));
+    }
+    array.status.push_back(status);
+  }
+
+  m_diagnostics_publisher->publish(array);
+}
+
+double CartesianAdaptiveComplianceController::nominalUpdateRate() const
+{
+#if defined CARTESIAN_CONTROLLERS_HUMBLE
+  if (get_update_rate() > 0)
+  {
+    return get_update_rate();
+  }
+#endif
+  return 1000.0;
+}
+
 void CartesianAdaptiveComplianceController::getEndEffectorPoseReal()
 {
   KDL::JntArray positions(Base::m_joint_state_pos_handles.size());
@@ -0,0 +1,412 @@
+#include <cartesian_adaptive_compliance_controller/data_reader.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// Smaller files are not worth splitting across threads
+constexpr size_t kMinChunkBytes = 1 << 20;
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+  ~MappedFile()
+  {
+    if (m_size > 0)
+    {
+      munmap(const_cast<char *>(m_data), m_size);
+    }
+  }
+
+  bool open(const std::string & filename, std::string & error)
+  {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      error = "Cannot open " + filename + ": " + std::strerror(errno);
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      error = "Cannot stat " + filename + ": " + std::strerror(errno);
+      close(fd);
+      return false;
+    }
+    if (info.st_size == 0)
+    {
+      close(fd);
+      return true;
+    }
+    void * memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+      error = "Cannot map " + filename + ": " + std::strerror(errno);
+      return false;
+    }
+    // The advice values are not flags, each needs a call of its own. Both
+    // are only hints, a kernel that rejects them still reads the file.
+    madvise(memory, info.st_size, MADV_SEQUENTIAL);
+    madvise(memory, info.st_size, MADV_WILLNEED);
+    m_data = static_cast<const char *>(memory);
+    m_size = info.st_size;
+    return true;
+  }
+
+  const char * begin() const { return m_data; }
+  const char * end() const { return m_data + m_size; }
+  size_t size() const { return m_size; }
+
+private:
+  const char * m_data = nullptr;
+  size_t m_size = 0;
+};
+
+// Numbers of a text file and how many of them each non-empty line holds
+struct ParsedText
+{
+  std::vector<double> values;
+  std::vector<uint32_t> line_lengths;
+
+  // Where parsing stopped, nullptr on success
+  const char * failure = nullptr;
+};
+
+bool isSeparator(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+void parseChunk(const char * begin, const char * end, ParsedText & result)
+{
+  // Most numbers MATLAB writes take more than eight characters
+  result.values.reserve((end - begin) / 8);
+
+  uint32_t on_line = 0;
+  const char * p = begin;
+  while (p < end)
+  {
+    if (*p == '\n')
+    {
+      if (on_line > 0)
+      {
+        result.line_lengths.push_back(on_line);
+      }
+      on_line = 0;
+      ++p;
+      continue;
+    }
+    if (isSeparator(*p))
+    {
+      ++p;
+      continue;
+    }
+
+    // std::from_chars does not accept an explicit plus sign
+    const char * start = (*p == '+' && p + 1 < end) ? p + 1 : p;
+    double value;
+    const auto [next, ec] = std::from_chars(start, end, value);
+    if (ec != std::errc() || (next < end && !isSeparator(*next) && *next != '\n'))
+    {
+      result.failure = p;
+      return;
+    }
+    result.values.push_back(value);
+    ++on_line;
+    p = next;
+  }
+  if (on_line > 0)
+  {
+    result.line_lengths.push_back(on_line);
+  }
+}
+
+// Splits \a file into chunks of whole lines and parses them in parallel
+bool parseFile(const std::string & filename, ParsedText & result, DataReaderTiming & timing,
+               std::string & error)
+{
+  const auto start = std::chrono::steady_clock::now();
+  timing = DataReaderTiming();
+  timing.filename = filename;
+
+  MappedFile file;
+  if (!file.open(filename, error))
+  {
+    return false;
+  }
+  timing.bytes = file.size();
+
+  const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t chunk_count = std::clamp<size_t>(file.size() / kMinChunkBytes, 1, threads);
+  std::vector<const char *> bounds(chunk_count + 1, file.end());
+  bounds[0] = file.begin();
+  for (size_t k = 1; k < chunk_count; ++k)
+  {
+    const char * split = std::max(bounds[k - 1], file.begin() + k * file.size() / chunk_count);
+    const void * newline = std::memchr(split, '\n', file.end() - split);
+    bounds[k] = newline != nullptr ? static_cast<const char *>(newline) + 1 : file.end();
+  }
+
+  std::vector<ParsedText> chunks(chunk_count);
+  std::vector<std::future<void>> workers;
+  for (size_t k = 1; k < chunk_count; ++k)
+  {
+    workers.push_back(std::async(std::launch::async, parseChunk, bounds[k], bounds[k + 1],
+                                 std::ref(chunks[k])));
+  }
+  parseChunk(bounds[0], bounds[1], chunks[0]);
+  for (auto & worker : workers)
+  {
+    worker.wait();
+  }
+
+  size_t value_count = 0;
+  size_t line_count = 0;
+  for (const ParsedText & chunk : chunks)
+  {
+    if (chunk.failure != nullptr)
+    {
+      const size_t line = std::count(file.begin(), chunk.failure, '\n') + 1;
+      const char * token_end = std::find_if(chunk.failure, file.end(), [](char c) {
+        return isSeparator(c) || c == '\n';
+      });
+      error = filename + ":" + std::to_string(line) + ": invalid number '" +
+              std::string(chunk.failure, std::min<size_t>(token_end - chunk.failure, 32)) + "'";
+      return false;
+    }
+    value_count += chunk.values.size();
+    line_count += chunk.line_lengths.size();
+  }
+
+  result.values.resize(value_count);
+  result.line_lengths.clear();
+  result.line_lengths.reserve(line_count);
+  double * out = result.values.data();
+  for (const ParsedText & chunk : chunks)
+  {
+    out = std::copy(chunk.values.begin(), chunk.values.end(), out);
+    result.line_lengths.insert(result.line_lengths.end(), chunk.line_lengths.begin(),
+                               chunk.line_lengths.end());
+  }
+
+  timing.values = value_count;
+  timing.seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+// Checks that \a text holds \a rows x \a cols values
+bool checkGrid(const std::string & filename, const ParsedText & text, size_t rows, size_t cols,
+               std::string & error)
+{
+  if (text.values.size() != rows * cols)
+  {
+    error = filename + " has " + std::to_string(text.values.size()) + " values, expected " +
+            std::to_string(rows) + " x " + std::to_string(cols);
+    return false;
+  }
+  if (text.line_lengths.size() == rows)
+  {
+    for (size_t i = 0; i < rows; ++i)
+    {
+      if (text.line_lengths[i] != cols)
+      {
+        error = filename + ": row " + std::to_string(i + 1) + " has " +
+                std::to_string(text.line_lengths[i]) + " values, expected " +
+                std::to_string(cols);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+namespace
+{
+// Parses the files of a grid concurrently, x and y coordinates first. The
+// remaining files must hold one value per cell, except \a table_count
+// trailing ones which are checked by the caller.
+bool readGrid(const std::string & directory, const std::vector<const char *> & names,
+              size_t table_count, std::vector<ParsedText> & texts,
+              std::vector<DataReaderTiming> & timings, std::string & error)
+{
+  const size_t count = names.size();
+  texts.assign(count, ParsedText());
+  timings.assign(count, DataReaderTiming());
+  std::vector<std::string> errors(count);
+  std::vector<char> ok(count);
+
+  auto parse = [&](size_t i) {
+    ok[i] = parseFile(directory + "/" + names[i], texts[i], timings[i], errors[i]);
+  };
+  std::vector<std::future<void>> workers;
+  for (size_t i = 1; i < count; ++i)
+  {
+    workers.push_back(std::async(std::launch::async, parse, i));
+  }
+  parse(0);
+  for (auto & worker : workers)
+  {
+    worker.wait();
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!ok[i])
+    {
+      error = errors[i];
+      return false;
+    }
+  }
+
+  const size_t rows = texts[0].values.size();
+  const size_t cols = texts[1].values.size();
+  for (size_t i = 2; i + table_count < count; ++i)
+  {
+    if (!checkGrid(directory + "/" + names[i], texts[i], rows, cols, error))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+bool dataReader(const std::string & directory, std::vector<double> & x_coordinates,
+                std::vector<double> & y_coordinates, std::vector<double> & z_values,
+                std::vector<double> & stiffness_values, std::vector<double> & damping_values,
+                std::vector<DataReaderTiming> & timings, std::string & error)
+{
+  std::vector<ParsedText> texts;
+  if (!readGrid(directory, {"x.txt", "y.txt", "z.txt", "stiffness.txt", "damping.txt"}, 0,
+                texts, timings, error))
+  {
+    return false;
+  }
+  x_coordinates = std::move(texts[0].values);
+  y_coordinates = std::move(texts[1].values);
+  z_values = std::move(texts[2].values);
+  stiffness_values = std::move(texts[3].values);
+  damping_values = std::move(texts[4].values);
+  return true;
+}
+
+bool materialMapReader(const std::string & directory, std::vector<double> & x_coordinates,
+                       std::vector<double> & y_coordinates, std::vector<double> & z_values,
+                       std::vector<double> & material_ids, std::vector<double> & materials,
+                       std::vector<DataReaderTiming> & timings, std::string & error)
+{
+  std::vector<ParsedText> texts;
+  if (!readGrid(directory, {"x.txt", "y.txt", "z.txt", "material.txt", "materials.txt"}, 1,
+                texts, timings, error))
+  {
+    return false;
+  }
+  const ParsedText & table = texts[4];
+  const bool complete_lines =
+    std::all_of(table.line_lengths.begin(), table.line_lengths.end(),
+                [](uint32_t length) { return length == kMaterialFields; });
+  if (table.values.empty() || !complete_lines)
+  {
+    error = directory + "/materials.txt: expected lines of '<id> <stiffness> <damping> "
+                        "<exponent> <max penetration> <min force>'";
+    return false;
+  }
+  x_coordinates = std::move(texts[0].values);
+  y_coordinates = std::move(texts[1].values);
+  z_values = std::move(texts[2].values);
+  material_ids = std::move(texts[3].values);
+  materials = std::move(texts[4].values);
+  return true;
+}
+
+bool pointCloudReader(const std::string & filename, std::vector<double> & values,
+                      DataReaderTiming & timing, std::string & error)
+{
+  ParsedText text;
+  if (!parseFile(filename, text, timing, error))
+  {
+    return false;
+  }
+  if (text.values.size() % 5 != 0)
+  {
+    error = filename + " has " + std::to_string(text.values.size()) +
+            " values, expected five per point";
+    return false;
+  }
+  values = std::move(text.values);
+  return true;
+}
+
+bool volumeReader(const std::string & filename, std::vector<double> & header,
+                  std::vector<double> & values, DataReaderTiming & timing, std::string & error)
+{
+  constexpr size_t kHeaderSize = 9;
+  ParsedText text;
+  if (!parseFile(filename, text, timing, error))
+  {
+    return false;
+  }
+  if (text.values.size() < kHeaderSize)
+  {
+    error = filename + " has no complete header";
+    return false;
+  }
+  const double * size = text.values.data();
+  for (size_t axis = 0; axis < 3; ++axis)
+  {
+    if (!(size[axis] >= 1.0) || size[axis] != std::floor(size[axis]) ||
+        !(size[axis + 6] > 0.0))
+    {
+      error = filename + ": sizes must be positive integers and spacings positive";
+      return false;
+    }
+  }
+  const size_t voxels = static_cast<size_t>(size[0]) * size[1] * size[2];
+  if (text.values.size() != kHeaderSize + 2 * voxels)
+  {
+    error = filename + " has " + std::to_string(text.values.size() - kHeaderSize) +
+            " values, expected two per voxel of " + std::to_string(voxels);
+    return false;
+  }
+  header.assign(text.values.begin(), text.values.begin() + kHeaderSize);
+  text.values.erase(text.values.begin(), text.values.begin() + kHeaderSize);
+  values = std::move(text.values);
+  return true;
+}
+
+std::string formatTimings(const std::vector<DataReaderTiming> & timings)
+{
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(1);
+  for (const DataReaderTiming & timing : timings)
+  {
+    report << timing.filename << ": " << timing.bytes / 1024.0 << " KiB, " << timing.values
+           << " values in " << timing.seconds * 1e3 << " ms\n";
+  }
+  return report.str();
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,215 @@
+#include <cartesian_adaptive_compliance_controller/flight_recorder.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <limits>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// How often the worker checks for a frozen ring
+constexpr auto kPollPeriod = std::chrono::milliseconds(10);
+}  // namespace
+
+const char * faultName(Fault fault)
+{
+  switch (fault)
+  {
+    case Fault::QpError:
+      return "qp_error";
+    case Fault::EmptyTank:
+      return "empty_tank";
+    case Fault::DeadlineOverrun:
+      return "deadline_overrun";
+    case Fault::NonFiniteStiffness:
+      return "non_finite_stiffness";
+    case Fault::LateCycle:
+      return "late_cycle";
+  }
+  return "unknown";
+}
+
+FlightRecorder::FlightRecorder()
+: m_mask(0),
+  m_sequence(0),
+  m_count(0),
+  m_stop_at(0),
+  m_armed_at(0),
+  m_fault(Fault::QpError),
+  m_fault_time(0.0),
+  m_state(Recording),
+  m_dumps(0),
+  m_stop(false)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  stop();
+}
+
+bool FlightRecorder::start(const std::string & directory, size_t samples, std::string & error)
+{
+  stop();
+  struct stat info;
+  if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+  {
+    error = directory + " is not a directory";
+    return false;
+  }
+  if (samples == 0)
+  {
+    error = "no samples to record";
+    return false;
+  }
+  size_t capacity = 1;
+  while (capacity < samples)
+  {
+    capacity *= 2;
+  }
+
+  m_directory = directory;
+  m_ring.assign(capacity, TelemetrySample());
+  m_snapshot.reserve(capacity);
+  m_mask = capacity - 1;
+  m_count = 0;
+  m_armed_at = 0;
+  m_state = Recording;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_last_dump.clear();
+    m_last_error.clear();
+  }
+
+  m_stop = false;
+  m_worker = std::thread(&FlightRecorder::workerLoop, this);
+  return true;
+}
+
+void FlightRecorder::stop()
+{
+  if (m_worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    m_worker.join();
+  }
+  m_ring.clear();
+  m_ring.shrink_to_fit();
+  m_snapshot.clear();
+  m_snapshot.shrink_to_fit();
+}
+
+void FlightRecorder::record(const TelemetrySample & sample)
+{
+  const int state = m_state.load(std::memory_order_acquire);
+  if (state == Frozen || m_ring.empty())
+  {
+    return;
+  }
+  m_ring[m_count & m_mask] = sample;
+  ++m_count;
+  if (state == Triggered && m_count >= m_stop_at)
+  {
+    m_state.store(Frozen, std::memory_order_release);
+  }
+}
+
+void FlightRecorder::trigger(Fault fault)
+{
+  if (m_ring.empty() || m_state.load(std::memory_order_acquire) != Recording ||
+      m_count < m_armed_at)
+  {
+    return;
+  }
+  m_fault = fault;
+  m_fault_time = m_count > 0 ? m_ring[(m_count - 1) & m_mask].time : 0.0;
+  m_stop_at = m_count + static_cast<uint64_t>(kPostTriggerShare * m_ring.size());
+  m_state.store(Triggered, std::memory_order_relaxed);
+}
+
+std::string FlightRecorder::lastDump() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_last_dump;
+}
+
+std::string FlightRecorder::lastError() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_last_error;
+}
+
+void FlightRecorder::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool stopping = false;
+  while (!stopping)
+  {
+    stopping = m_stop_cv.wait_for(lock, kPollPeriod, [this] { return m_stop; });
+    if (m_state.load(std::memory_order_acquire) != Frozen)
+    {
+      continue;
+    }
+    lock.unlock();
+
+    // Oldest sample first. The real-time thread waits for the state to
+    // change before touching the ring again.
+    const uint64_t count = std::min<uint64_t>(m_count, m_ring.size());
+    m_snapshot.clear();
+    for (uint64_t i = m_count - count; i < m_count; ++i)
+    {
+      m_snapshot.push_back(m_ring[i & m_mask]);
+    }
+    const Fault fault = m_fault;
+    const double fault_time = m_fault_time;
+    m_armed_at = m_count + m_ring.size();
+    m_state.store(Recording, std::memory_order_release);
+
+    dump(fault, fault_time);
+    lock.lock();
+  }
+}
+
+void FlightRecorder::dump(Fault fault, double time)
+{
+  char stamp[32];
+  const std::time_t now = std::time(nullptr);
+  std::tm local;
+  localtime_r(&now, &local);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+  const std::string file = m_directory + "/flight_recorder_" + stamp + "_" +
+                           std::to_string(++m_sequence) + "_" + faultName(fault) + ".csv";
+
+  std::ofstream out(file);
+  out.precision(std::numeric_limits<double>::max_digits10);
+  out << "# " << faultName(fault) << " at " << time << '\n';
+  writeTelemetryCsvHeader(out);
+  for (const TelemetrySample & sample : m_snapshot)
+  {
+    writeTelemetryCsvRow(out, sample);
+  }
+  out.close();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (out)
+  {
+    m_last_dump = file;
+    m_dumps.fetch_add(1);
+  }
+  else
+  {
+    m_last_error = "cannot write " + file;
+  }
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,176 @@
+#include <cartesian_adaptive_compliance_controller/latency_monitor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// Long enough to measure the counter frequency to about 1e-5
+constexpr auto kCalibrationTime = std::chrono::milliseconds(20);
+
+// Whether the time stamp counter ticks at a constant rate, also in deep
+// sleep states. Only then are its differences proportional to time.
+bool hasInvariantTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line))
+  {
+    if (line.compare(0, 5, "flags") == 0)
+    {
+      std::istringstream flags(line);
+      std::string flag;
+      bool constant = false;
+      bool nonstop = false;
+      while (flags >> flag)
+      {
+        constant = constant || flag == "constant_tsc";
+        nonstop = nonstop || flag == "nonstop_tsc";
+      }
+      return constant && nonstop;
+    }
+  }
+#endif
+  return false;
+}
+}  // namespace
+
+void LatencyHistogram::takeWindow(std::vector<uint64_t> & window)
+{
+  m_taken.resize(kBuckets, 0);
+  window.resize(kBuckets);
+  for (size_t i = 0; i < kBuckets; ++i)
+  {
+    const uint64_t count = m_counts[i].load(std::memory_order_relaxed);
+    window[i] = count - m_taken[i];
+    m_taken[i] = count;
+  }
+}
+
+uint64_t LatencyHistogram::quantile(const std::vector<uint64_t> & window, double quantile)
+{
+  uint64_t total = 0;
+  for (uint64_t count : window)
+  {
+    total += count;
+  }
+  if (total == 0)
+  {
+    return 0;
+  }
+  const uint64_t rank =
+    std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < window.size(); ++i)
+  {
+    seen += window[i];
+    if (seen >= rank)
+    {
+      return bucketLimit(i);
+    }
+  }
+  return bucketLimit(window.size() - 1);
+}
+
+size_t LatencyHistogram::bucket(uint64_t value)
+{
+  value = std::min(value, kMaxValue);
+  if (value < 2 * kSubBuckets)
+  {
+    return value;
+  }
+  const unsigned exponent = 63 - __builtin_clzll(value);
+  const unsigned shift = exponent - kSubBucketBits;
+  return shift * kSubBuckets + (value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketLimit(size_t bucket)
+{
+  if (bucket < 2 * kSubBuckets)
+  {
+    return bucket;
+  }
+  const unsigned shift = bucket / kSubBuckets - 1;
+  const uint64_t mantissa = bucket % kSubBuckets + kSubBuckets;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+const char * latencyPhaseName(LatencyPhase phase)
+{
+  switch (phase)
+  {
+    case LatencyPhase::Synchronize:
+      return "synchronize_joint_positions";
+    case LatencyPhase::EndEffectorPose:
+      return "end_effector_pose";
+    case LatencyPhase::MapLookup:
+      return "surface_map_lookup";
+    case LatencyPhase::QpSolve:
+      return "qp_solve";
+    case LatencyPhase::ComplianceIterations:
+      return "compliance_iterations";
+    case LatencyPhase::WriteCommands:
+      return "write_joint_commands";
+    case LatencyPhase::Count:
+      break;
+  }
+  return "unknown";
+}
+
+LatencyMonitor::LatencyMonitor()
+: m_tsc(false),
+  m_nanoseconds_per_tick(1.0)
+{
+}
+
+void LatencyMonitor::calibrate()
+{
+  m_tsc = false;
+  m_nanoseconds_per_tick = 1.0;
+  if (!hasInvariantTsc())
+  {
+    return;
+  }
+  m_tsc = true;
+  const auto steady_start = std::chrono::steady_clock::now();
+  const uint64_t tsc_start = now();
+  std::this_thread::sleep_for(kCalibrationTime);
+  const auto steady_end = std::chrono::steady_clock::now();
+  const uint64_t tsc_end = now();
+  const double nanoseconds =
+    std::chrono::duration<double, std::nano>(steady_end - steady_start).count();
+  if (tsc_end <= tsc_start)
+  {
+    m_tsc = false;
+    return;
+  }
+  m_nanoseconds_per_tick = nanoseconds / (tsc_end - tsc_start);
+}
+
+void LatencyMonitor::summarize(std::array<LatencySummary, kLatencyPhases> & summaries)
+{
+  for (size_t i = 0; i < kLatencyPhases; ++i)
+  {
+    m_histograms[i].takeWindow(m_window);
+    LatencySummary & summary = summaries[i];
+    summary.samples = 0;
+    for (uint64_t count : m_window)
+    {
+      summary.samples += count;
+    }
+    summary.p50 = LatencyHistogram::quantile(m_window, 0.5);
+    summary.p99 = LatencyHistogram::quantile(m_window, 0.99);
+    summary.p999 = LatencyHistogram::quantile(m_window, 0.999);
+    summary.max = LatencyHistogram::quantile(m_window, 1.0);
+  }
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
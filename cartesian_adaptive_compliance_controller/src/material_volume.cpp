@@ -0,0 +1,162 @@
+#include <cartesian_adaptive_compliance_controller/data_reader.h>
+#include <cartesian_adaptive_compliance_controller/material_volume.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+bool MaterialVolume::build(const std::vector<double> & header, const std::vector<double> & values,
+                           std::string & error)
+{
+  *this = MaterialVolume();
+  for (size_t axis = 0; axis < 3; ++axis)
+  {
+    m_size[axis] = static_cast<size_t>(header[axis]);
+    m_origin[axis] = header[axis + 3];
+    m_spacing[axis] = header[axis + 6];
+    m_bricks[axis] = (m_size[axis] + kBrickSize - 1) / kBrickSize;
+  }
+  if (!std::isfinite(m_origin[0]) || !std::isfinite(m_origin[1]) || !std::isfinite(m_origin[2]))
+  {
+    error = "Material volume origin is not finite";
+    return false;
+  }
+  const size_t brick_count = m_bricks[0] * m_bricks[1] * m_bricks[2];
+  if (brick_count > static_cast<size_t>(std::numeric_limits<int32_t>::max()))
+  {
+    error = "Material volume has too many bricks";
+    return false;
+  }
+
+  auto source = [&](size_t i, size_t j, size_t k) {
+    const size_t index = 2 * ((i * m_size[1] + j) * m_size[2] + k);
+    return Voxel{static_cast<float>(values[index]), static_cast<float>(values[index + 1])};
+  };
+
+  m_brick_index.resize(brick_count);
+  Voxel brick[kBrickSize][kBrickSize][kBrickSize];
+  for (size_t bi = 0; bi < m_bricks[0]; ++bi)
+  {
+    for (size_t bj = 0; bj < m_bricks[1]; ++bj)
+    {
+      for (size_t bk = 0; bk < m_bricks[2]; ++bk)
+      {
+        // Voxels beyond the grid repeat its last layer and are never read
+        bool uniform = true;
+        for (size_t i = 0; i < kBrickSize; ++i)
+        {
+          for (size_t j = 0; j < kBrickSize; ++j)
+          {
+            for (size_t k = 0; k < kBrickSize; ++k)
+            {
+              brick[i][j][k] = source(std::min(bi * kBrickSize + i, m_size[0] - 1),
+                                      std::min(bj * kBrickSize + j, m_size[1] - 1),
+                                      std::min(bk * kBrickSize + k, m_size[2] - 1));
+              uniform = uniform && brick[i][j][k] == brick[0][0][0];
+            }
+          }
+        }
+        int32_t & entry = m_brick_index[(bi * m_bricks[1] + bj) * m_bricks[2] + bk];
+        if (uniform)
+        {
+          entry = -1 - static_cast<int32_t>(m_uniform.size());
+          m_uniform.push_back(brick[0][0][0]);
+        }
+        else
+        {
+          entry = static_cast<int32_t>(m_voxels.size() / (kBrickSize * kBrickSize * kBrickSize));
+          m_voxels.insert(m_voxels.end(), &brick[0][0][0],
+                          &brick[0][0][0] + kBrickSize * kBrickSize * kBrickSize);
+        }
+      }
+    }
+  }
+  m_voxels.shrink_to_fit();
+  m_uniform.shrink_to_fit();
+  return true;
+}
+
+bool MaterialVolume::sample(double x, double y, double depth, double & stiffness,
+                            double & damping) const
+{
+  const double p[3] = {x, y, depth};
+  size_t i[3];
+  size_t step[3];
+  double t[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    double u = (p[axis] - m_origin[axis]) / m_spacing[axis];
+    const double last = static_cast<double>(m_size[axis] - 1);
+    if (axis < 2 && !(u >= 0.0 && u <= last))
+    {
+      return false;
+    }
+    u = std::clamp(u, 0.0, last);
+    i[axis] = std::min(static_cast<size_t>(u), m_size[axis] > 1 ? m_size[axis] - 2 : 0);
+    step[axis] = m_size[axis] > 1 ? 1 : 0;
+    t[axis] = m_size[axis] > 1 ? u - i[axis] : 0.0;
+  }
+
+  // Interpolate along depth, then y, then x
+  double corner[2][2][2];
+  for (size_t a = 0; a < 2; ++a)
+  {
+    for (size_t b = 0; b < 2; ++b)
+    {
+      const Voxel & v0 = voxel(i[0] + a * step[0], i[1] + b * step[1], i[2]);
+      const Voxel & v1 = voxel(i[0] + a * step[0], i[1] + b * step[1], i[2] + step[2]);
+      corner[a][b][0] = v0.stiffness + t[2] * (v1.stiffness - v0.stiffness);
+      corner[a][b][1] = v0.damping + t[2] * (v1.damping - v0.damping);
+    }
+  }
+  double value[2];
+  for (size_t c = 0; c < 2; ++c)
+  {
+    const double c0 = corner[0][0][c] + t[1] * (corner[0][1][c] - corner[0][0][c]);
+    const double c1 = corner[1][0][c] + t[1] * (corner[1][1][c] - corner[1][0][c]);
+    value[c] = c0 + t[0] * (c1 - c0);
+  }
+  stiffness = value[0];
+  damping = value[1];
+  return true;
+}
+
+size_t MaterialVolume::memorySize() const
+{
+  return m_brick_index.size() * sizeof(int32_t) +
+         (m_voxels.size() + m_uniform.size()) * sizeof(Voxel);
+}
+
+std::string MaterialVolume::describe() const
+{
+  const size_t voxels = m_size[0] * m_size[1] * m_size[2];
+  std::ostringstream text;
+  text << "material volume " << m_size[0] << " x " << m_size[1] << " x " << m_size[2]
+       << " voxels, depth " << m_origin[2] << " .. "
+       << m_origin[2] + (m_size[2] - 1) * m_spacing[2] << " m, "
+       << m_voxels.size() / (kBrickSize * kBrickSize * kBrickSize) << " of "
+       << m_brick_index.size() << " bricks stored, "
+       << voxels * sizeof(Voxel) / 1048576.0 << " -> " << memorySize() / 1048576.0 << " MiB\n";
+  return text.str();
+}
+
+bool readMaterialVolume(const std::string & filename, MaterialVolume & volume,
+                        std::string & report, std::string & error)
+{
+  std::vector<double> header;
+  std::vector<double> values;
+  DataReaderTiming timing;
+  if (!volumeReader(filename, header, values, timing, error) ||
+      !volume.build(header, values, error))
+  {
+    return false;
+  }
+  report += formatTimings({timing}) + volume.describe();
+  return true;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
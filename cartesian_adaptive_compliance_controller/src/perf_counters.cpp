@@ -0,0 +1,277 @@
+#include <cartesian_adaptive_compliance_controller/perf_counters.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// glibc has no wrapper for it
+int perfEventOpen(perf_event_attr & attributes, pid_t thread, int group)
+{
+  return static_cast<int>(
+    syscall(SYS_perf_event_open, &attributes, thread, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+
+perf_event_attr eventAttributes(PerfEvent event)
+{
+  perf_event_attr attributes;
+  std::memset(&attributes, 0, sizeof(attributes));
+  attributes.size = sizeof(attributes);
+  attributes.type = PERF_TYPE_HARDWARE;
+  switch (event)
+  {
+    case PerfEvent::Cycles:
+      attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PerfEvent::Instructions:
+      attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PerfEvent::L1dReadMisses:
+      attributes.type = PERF_TYPE_HW_CACHE;
+      attributes.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case PerfEvent::LlcMisses:
+      attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case PerfEvent::BranchMisses:
+      attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case PerfEvent::Count:
+      break;
+  }
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return attributes;
+}
+
+// Counters have a single writer, so no read-modify-write is needed
+void add(std::atomic<uint64_t> & counter, uint64_t value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+}  // namespace
+
+const char * perfSectionName(PerfSection section)
+{
+  switch (section)
+  {
+    case PerfSection::ComputeStiffness:
+      return "compute_stiffness";
+    case PerfSection::MapLookup:
+      return "surface_map_lookup";
+    case PerfSection::Count:
+      break;
+  }
+  return "unknown";
+}
+
+const char * perfEventName(PerfEvent event)
+{
+  switch (event)
+  {
+    case PerfEvent::Cycles:
+      return "cycles";
+    case PerfEvent::Instructions:
+      return "instructions";
+    case PerfEvent::L1dReadMisses:
+      return "l1d_read_misses";
+    case PerfEvent::LlcMisses:
+      return "llc_misses";
+    case PerfEvent::BranchMisses:
+      return "branch_misses";
+    case PerfEvent::Count:
+      break;
+  }
+  return "unknown";
+}
+
+PerfCounters::PerfCounters()
+: m_state(Stopped),
+  m_thread(0),
+  m_count(0),
+  m_begin{},
+  m_end{},
+  m_samples{},
+  m_totals{},
+  m_supported{},
+  m_seen_samples{},
+  m_seen_totals{}
+{
+  for (int & fd : m_fds)
+  {
+    fd = -1;
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  close();
+}
+
+void PerfCounters::start()
+{
+  close();
+  m_error.clear();
+  for (Reading & reading : m_begin)
+  {
+    reading.count = 0;
+  }
+  std::array<PerfSummary, kPerfSections> discarded;
+  summarize(discarded);
+  m_state.store(Started, std::memory_order_release);
+}
+
+void PerfCounters::stop()
+{
+  close();
+  m_state.store(Stopped, std::memory_order_release);
+}
+
+bool PerfCounters::isStarted() const
+{
+  return m_state.load() != Stopped;
+}
+
+bool PerfCounters::hasFailed() const
+{
+  return m_state.load() == Failed;
+}
+
+bool PerfCounters::ready()
+{
+  const int state = m_state.load(std::memory_order_acquire);
+  if (state == Started)
+  {
+    m_thread = static_cast<pid_t>(syscall(SYS_gettid));
+    m_state.store(Registered, std::memory_order_release);
+    return false;
+  }
+  return state == Open;
+}
+
+void PerfCounters::begin(PerfSection section)
+{
+  Reading & reading = m_begin[static_cast<size_t>(section)];
+  if (!ready() || !readGroup(reading))
+  {
+    reading.count = 0;
+  }
+}
+
+void PerfCounters::end(PerfSection section)
+{
+  const size_t index = static_cast<size_t>(section);
+  const Reading & begin = m_begin[index];
+  if (m_state.load(std::memory_order_acquire) != Open || begin.count != m_count ||
+      !readGroup(m_end))
+  {
+    return;
+  }
+
+  // The group was not on the CPU during the section, e.g. while the
+  // kernel multiplexed other events
+  if (m_end.time_running == begin.time_running)
+  {
+    return;
+  }
+  for (size_t i = 0; i < m_count; ++i)
+  {
+    add(m_totals[index][static_cast<size_t>(m_events[i])], m_end.values[i] - begin.values[i]);
+  }
+  add(m_samples[index], 1);
+}
+
+bool PerfCounters::readGroup(Reading & reading)
+{
+  const ssize_t size = sizeof(uint64_t) * (2 + m_count);
+  return read(m_fds[0], &reading, size) == size;
+}
+
+bool PerfCounters::open(std::string & error)
+{
+  const int state = m_state.load(std::memory_order_acquire);
+  if (state == Failed)
+  {
+    error = m_error;
+    return false;
+  }
+  if (state != Registered)
+  {
+    return true;
+  }
+
+  // Only the leader is essential. The group counts while all its events
+  // fit into the counters of the CPU.
+  m_count = 0;
+  for (size_t i = 0; i < kPerfEvents; ++i)
+  {
+    const PerfEvent event = static_cast<PerfEvent>(i);
+    perf_event_attr attributes = eventAttributes(event);
+    attributes.disabled = m_count == 0;
+    const int fd = perfEventOpen(attributes, m_thread, m_count == 0 ? -1 : m_fds[0]);
+    if (fd < 0 && m_count == 0)
+    {
+      m_error = std::string("cannot count ") + perfEventName(event) + ": " + std::strerror(errno);
+      error = m_error;
+      m_state.store(Failed, std::memory_order_release);
+      return false;
+    }
+    m_supported[i] = fd >= 0;
+    if (fd >= 0)
+    {
+      m_fds[m_count] = fd;
+      m_events[m_count] = event;
+      ++m_count;
+    }
+  }
+  ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  m_state.store(Open, std::memory_order_release);
+  return true;
+}
+
+void PerfCounters::summarize(std::array<PerfSummary, kPerfSections> & summaries)
+{
+  for (size_t s = 0; s < kPerfSections; ++s)
+  {
+    PerfSummary & summary = summaries[s];
+    const uint64_t samples = m_samples[s].load(std::memory_order_relaxed);
+    summary.samples = samples - m_seen_samples[s];
+    m_seen_samples[s] = samples;
+    for (size_t e = 0; e < kPerfEvents; ++e)
+    {
+      const uint64_t total = m_totals[s][e].load(std::memory_order_relaxed);
+      summary.per_sample[e] = m_supported[e] && summary.samples > 0
+                                ? static_cast<double>(total - m_seen_totals[s][e]) / summary.samples
+                                : std::numeric_limits<double>::quiet_NaN();
+      m_seen_totals[s][e] = total;
+    }
+  }
+}
+
+void PerfCounters::close()
+{
+  for (size_t i = 0; i < m_count; ++i)
+  {
+    ::close(m_fds[i]);
+    m_fds[i] = -1;
+  }
+  m_count = 0;
+  for (bool & supported : m_supported)
+  {
+    supported = false;
+  }
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,115 @@
+#include <cartesian_adaptive_compliance_controller/period_monitor.h>
+
+#include <algorithm>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+uint64_t toNanoseconds(double seconds)
+{
+  return static_cast<uint64_t>(std::max(seconds, 0.0) * 1e9);
+}
+
+uint64_t absoluteDifference(uint64_t a, uint64_t b)
+{
+  return a > b ? a - b : b - a;
+}
+}  // namespace
+
+PeriodMonitor::PeriodMonitor()
+: m_nominal_period(0),
+  m_late_period(0),
+  m_deadline(0),
+  m_first(true),
+  m_updates(0),
+  m_skipped(0),
+  m_late(0),
+  m_overruns(0),
+  m_seen_updates(0),
+  m_seen_skipped(0),
+  m_seen_late(0),
+  m_seen_overruns(0)
+{
+}
+
+void PeriodMonitor::configure(double nominal_period, double tolerance, double deadline)
+{
+  m_nominal_period = toNanoseconds(nominal_period);
+  m_late_period = toNanoseconds(nominal_period * (1.0 + tolerance));
+  m_deadline = toNanoseconds(deadline);
+  m_first = true;
+
+  PeriodSummary discarded;
+  summarize(discarded);
+}
+
+bool PeriodMonitor::recordPeriod(int64_t nanoseconds)
+{
+  increment(m_updates);
+  if (m_first)
+  {
+    m_first = false;
+    return false;
+  }
+  const uint64_t period = static_cast<uint64_t>(std::max<int64_t>(nanoseconds, 0));
+  m_periods.record(period);
+  m_jitter.record(absoluteDifference(period, m_nominal_period));
+  if (period > m_late_period)
+  {
+    increment(m_late);
+    return true;
+  }
+  return false;
+}
+
+bool PeriodMonitor::recordComputeTime(int64_t nanoseconds)
+{
+  const uint64_t compute_time = static_cast<uint64_t>(std::max<int64_t>(nanoseconds, 0));
+  m_compute_times.record(compute_time);
+  if (compute_time > m_deadline)
+  {
+    increment(m_overruns);
+    return true;
+  }
+  return false;
+}
+
+void PeriodMonitor::summarize(PeriodSummary & summary)
+{
+  summary.nominal_period = m_nominal_period;
+  summary.deadline = m_deadline;
+
+  // The counters only grow, so the window is what they grew by
+  auto window = [](const std::atomic<uint64_t> & counter, uint64_t & seen) {
+    const uint64_t count = counter.load(std::memory_order_relaxed);
+    const uint64_t grown = count - seen;
+    seen = count;
+    return grown;
+  };
+  summary.updates = window(m_updates, m_seen_updates);
+  summary.skipped = window(m_skipped, m_seen_skipped);
+  summary.late = window(m_late, m_seen_late);
+  summary.overruns = window(m_overruns, m_seen_overruns);
+
+  m_periods.takeWindow(m_window);
+  summary.period_p50 = LatencyHistogram::quantile(m_window, 0.5);
+  summary.period_p999 = LatencyHistogram::quantile(m_window, 0.999);
+  summary.period_max = LatencyHistogram::quantile(m_window, 1.0);
+
+  m_jitter.takeWindow(m_window);
+  summary.jitter_p999 = LatencyHistogram::quantile(m_window, 0.999);
+  summary.jitter_max = LatencyHistogram::quantile(m_window, 1.0);
+
+  m_compute_times.takeWindow(m_window);
+  summary.compute_p50 = LatencyHistogram::quantile(m_window, 0.5);
+  summary.compute_p999 = LatencyHistogram::quantile(m_window, 0.999);
+  summary.compute_max = LatencyHistogram::quantile(m_window, 1.0);
+
+  const double period = m_nominal_period > 0 ? static_cast<double>(m_nominal_period) : 1.0;
+  summary.load_p999 = summary.compute_p999 / period;
+  summary.load_max = summary.compute_max / period;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
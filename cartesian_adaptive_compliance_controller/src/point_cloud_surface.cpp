@@ -0,0 +1,214 @@
+#include <cartesian_adaptive_compliance_controller/point_cloud_surface.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+bool PointCloudSurface::build(std::vector<SurfacePoint> points, double points_per_bucket,
+                              std::string & error)
+{
+  if (points.empty())
+  {
+    error = "Point cloud is empty";
+    return false;
+  }
+  if (points.size() >= std::numeric_limits<uint32_t>::max())
+  {
+    error = "Point cloud has too many points";
+    return false;
+  }
+
+  double min_x = std::numeric_limits<double>::max();
+  double min_y = std::numeric_limits<double>::max();
+  double max_x = std::numeric_limits<double>::lowest();
+  double max_y = std::numeric_limits<double>::lowest();
+  for (const SurfacePoint & p : points)
+  {
+    if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z) ||
+        !std::isfinite(p.stiffness) || !std::isfinite(p.damping))
+    {
+      error = "Point cloud contains non-finite values";
+      return false;
+    }
+    min_x = std::min(min_x, p.x);
+    min_y = std::min(min_y, p.y);
+    max_x = std::max(max_x, p.x);
+    max_y = std::max(max_y, p.y);
+  }
+
+  // Size the buckets for the requested mean occupancy
+  const double area = std::max(max_x - min_x, 1e-6) * std::max(max_y - min_y, 1e-6);
+  const double bucket_size = std::sqrt(area * points_per_bucket / points.size());
+  m_min_x = min_x;
+  m_min_y = min_y;
+  m_inv_bucket_size = 1.0 / bucket_size;
+  m_nx = static_cast<long>((max_x - min_x) * m_inv_bucket_size) + 1;
+  m_ny = static_cast<long>((max_y - min_y) * m_inv_bucket_size) + 1;
+
+  auto bucket_of = [this](const SurfacePoint & p) {
+    long ix = std::min(static_cast<long>((p.x - m_min_x) * m_inv_bucket_size), m_nx - 1);
+    long iy = std::min(static_cast<long>((p.y - m_min_y) * m_inv_bucket_size), m_ny - 1);
+    return bucketIndex(ix, iy);
+  };
+
+  // Counting sort into buckets. Crowded buckets are thinned out evenly to
+  // keep the query time bounded.
+  const size_t buckets = static_cast<size_t>(m_nx) * m_ny;
+  std::vector<uint32_t> counts(buckets, 0);
+  for (const SurfacePoint & p : points)
+  {
+    ++counts[bucket_of(p)];
+  }
+
+  m_bucket_start.assign(buckets + 1, 0);
+  for (size_t b = 0; b < buckets; ++b)
+  {
+    m_bucket_start[b + 1] =
+      m_bucket_start[b] + std::min<uint32_t>(counts[b], kMaxPointsPerBucket);
+  }
+
+  std::vector<uint32_t> seen(buckets, 0);
+  std::vector<uint32_t> fill(m_bucket_start.begin(), m_bucket_start.end() - 1);
+  m_points.resize(m_bucket_start.back());
+  m_dropped_points = 0;
+  for (const SurfacePoint & p : points)
+  {
+    const size_t b = bucket_of(p);
+    const uint32_t stride = (counts[b] + kMaxPointsPerBucket - 1) / kMaxPointsPerBucket;
+    if (seen[b]++ % stride == 0 && fill[b] < m_bucket_start[b + 1])
+    {
+      m_points[fill[b]++] = p;
+    }
+    else
+    {
+      ++m_dropped_points;
+    }
+  }
+  return true;
+}
+
+bool PointCloudSurface::sample(double x, double y, SurfaceSample & sample) const
+{
+  if (m_points.empty())
+  {
+    return false;
+  }
+
+  // The kNeighbors nearest points found so far, sorted by distance
+  const SurfacePoint * nearest[kNeighbors];
+  double distances[kNeighbors];
+  size_t found = 0;
+
+  auto consider = [&](const SurfacePoint & p) {
+    const double d = (p.x - x) * (p.x - x) + (p.y - y) * (p.y - y);
+    if (found == kNeighbors && d >= distances[kNeighbors - 1])
+    {
+      return;
+    }
+    size_t i = found < kNeighbors ? found++ : kNeighbors - 1;
+    while (i > 0 && distances[i - 1] > d)
+    {
+      distances[i] = distances[i - 1];
+      nearest[i] = nearest[i - 1];
+      --i;
+    }
+    distances[i] = d;
+    nearest[i] = &p;
+  };
+
+  // Beyond the bucket ring around the cloud there is nothing to sample
+  const double bx = std::floor((x - m_min_x) * m_inv_bucket_size);
+  const double by = std::floor((y - m_min_y) * m_inv_bucket_size);
+  if (!(bx >= -1.0 && bx <= m_nx && by >= -1.0 && by <= m_ny))
+  {
+    return false;
+  }
+  const long cx = std::clamp(static_cast<long>(bx), 0L, m_nx - 1);
+  const long cy = std::clamp(static_cast<long>(by), 0L, m_ny - 1);
+
+  for (long ring = 1; ring <= 2 && found == 0; ++ring)
+  {
+    for (long iy = std::max(cy - ring, 0L); iy <= std::min(cy + ring, m_ny - 1); ++iy)
+    {
+      for (long ix = std::max(cx - ring, 0L); ix <= std::min(cx + ring, m_nx - 1); ++ix)
+      {
+        // The inner buckets were searched in the previous ring already
+        if (ring > 1 && std::abs(ix - cx) < ring && std::abs(iy - cy) < ring)
+        {
+          continue;
+        }
+        const size_t b = bucketIndex(ix, iy);
+        for (uint32_t k = m_bucket_start[b]; k < m_bucket_start[b + 1]; ++k)
+        {
+          consider(m_points[k]);
+        }
+      }
+    }
+  }
+  // A gap wider than the points are apart is not part of the surface
+  const double max_distance = kMaxGap / m_inv_bucket_size;
+  if (found == 0 || distances[0] > max_distance * max_distance)
+  {
+    return false;
+  }
+
+  // Inverse distance weights, regularized for points on top of the query
+  const double epsilon = 1e-4 / (m_inv_bucket_size * m_inv_bucket_size);
+  double weight_sum = 0.0;
+  double z = 0.0, stiffness = 0.0, damping = 0.0;
+
+  // Normal equations of the weighted plane fit z = a + b * dx + c * dy
+  double s_1 = 0.0, s_x = 0.0, s_y = 0.0, s_xx = 0.0, s_xy = 0.0, s_yy = 0.0;
+  double s_z = 0.0, s_xz = 0.0, s_yz = 0.0;
+  for (size_t i = 0; i < found; ++i)
+  {
+    const SurfacePoint & p = *nearest[i];
+    const double w = 1.0 / (distances[i] + epsilon);
+    weight_sum += w;
+    z += w * p.z;
+    stiffness += w * p.stiffness;
+    damping += w * p.damping;
+
+    const double dx = p.x - x;
+    const double dy = p.y - y;
+    s_1 += w;
+    s_x += w * dx;
+    s_y += w * dy;
+    s_xx += w * dx * dx;
+    s_xy += w * dx * dy;
+    s_yy += w * dy * dy;
+    s_z += w * p.z;
+    s_xz += w * dx * p.z;
+    s_yz += w * dy * p.z;
+  }
+
+  sample.z = z / weight_sum;
+  sample.stiffness = stiffness / weight_sum;
+  sample.damping = damping / weight_sum;
+  sample.dz_dx = 0.0;
+  sample.dz_dy = 0.0;
+
+  // Cramer's rule. Skipped for too few or collinear points.
+  const double det = s_1 * (s_xx * s_yy - s_xy * s_xy) - s_x * (s_x * s_yy - s_xy * s_y) +
+                     s_y * (s_x * s_xy - s_xx * s_y);
+  const double scale = s_1 * s_xx * s_yy;
+  if (found >= 3 && std::abs(det) > 1e-9 * std::abs(scale))
+  {
+    sample.z = (s_z * (s_xx * s_yy - s_xy * s_xy) - s_x * (s_xz * s_yy - s_xy * s_yz) +
+                s_y * (s_xz * s_xy - s_xx * s_yz)) /
+               det;
+    sample.dz_dx = (s_1 * (s_xz * s_yy - s_xy * s_yz) - s_z * (s_x * s_yy - s_xy * s_y) +
+                    s_y * (s_x * s_yz - s_xz * s_y)) /
+                   det;
+    sample.dz_dy = (s_1 * (s_xx * s_yz - s_xz * s_xy) - s_x * (s_x * s_yz - s_xz * s_y) +
+                    s_z * (s_x * s_xy - s_xx * s_y)) /
+                   det;
+  }
+  return true;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
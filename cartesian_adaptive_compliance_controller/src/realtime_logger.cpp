@@ -0,0 +1,114 @@
+#include <cartesian_adaptive_compliance_controller/realtime_logger.h>
+
+#include <sstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// How often the worker looks for new messages
+constexpr auto kPollPeriod = std::chrono::milliseconds(10);
+
+const char * const kFormats[kLogMessages] = {
+#define LOG_MESSAGE_FORMAT(name, level, interval, format) format,
+  ADAPTIVE_COMPLIANCE_LOG_MESSAGES(LOG_MESSAGE_FORMAT)
+#undef LOG_MESSAGE_FORMAT
+};
+
+const LogLevel kLevels[kLogMessages] = {
+#define LOG_MESSAGE_LEVEL(name, level, interval, format) LogLevel::level,
+  ADAPTIVE_COMPLIANCE_LOG_MESSAGES(LOG_MESSAGE_LEVEL)
+#undef LOG_MESSAGE_LEVEL
+};
+}  // namespace
+
+const std::chrono::steady_clock::duration RealtimeLogger::kIntervals[kLogMessages] = {
+#define LOG_MESSAGE_INTERVAL(name, level, interval, format)            \
+  std::chrono::duration_cast<std::chrono::steady_clock::duration>( \
+    std::chrono::duration<double>(interval)),
+  ADAPTIVE_COMPLIANCE_LOG_MESSAGES(LOG_MESSAGE_INTERVAL)
+#undef LOG_MESSAGE_INTERVAL
+};
+
+RealtimeLogger::RealtimeLogger()
+: m_next{},
+  m_suppressed{},
+  m_stop(false)
+{
+}
+
+RealtimeLogger::~RealtimeLogger()
+{
+  stop();
+}
+
+void RealtimeLogger::start(Sink sink)
+{
+  stop();
+  m_entries.clear();
+  for (size_t i = 0; i < kLogMessages; ++i)
+  {
+    m_next[i] = std::chrono::steady_clock::time_point();
+    m_suppressed[i] = 0;
+  }
+  m_sink = std::move(sink);
+  m_stop = false;
+  m_worker = std::thread(&RealtimeLogger::workerLoop, this);
+}
+
+void RealtimeLogger::stop()
+{
+  if (m_worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    m_worker.join();
+  }
+}
+
+void RealtimeLogger::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool stopping = false;
+  while (!stopping)
+  {
+    stopping = m_stop_cv.wait_for(lock, kPollPeriod, [this] { return m_stop; });
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+}
+
+void RealtimeLogger::drain()
+{
+  Entry entry;
+  while (m_entries.pop(entry))
+  {
+    const size_t index = static_cast<size_t>(entry.message);
+    std::ostringstream text;
+    size_t argument = 0;
+    for (const char * c = kFormats[index]; *c != '\0'; ++c)
+    {
+      if (c[0] == '{' && c[1] == '}' && argument < entry.count)
+      {
+        text << entry.arguments[argument++];
+        ++c;
+      }
+      else
+      {
+        text << *c;
+      }
+    }
+    if (entry.suppressed > 0)
+    {
+      text << " (" << entry.suppressed << " more suppressed)";
+    }
+    m_sink(kLevels[index], text.str());
+  }
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,148 @@
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// Index range of \a coordinates (ascending) within [low, high]
+void indexRange(ArrayView<double> coordinates, double low, double high, size_t & first,
+                size_t & last)
+{
+  first = std::lower_bound(coordinates.begin(), coordinates.end(), low) - coordinates.begin();
+  last = std::upper_bound(coordinates.begin(), coordinates.end(), high) - coordinates.begin();
+}
+
+// The coarsest pyramid level that still resolves \a resolution
+const SurfaceGrid & sourceLevel(const SurfaceMap & map, double resolution)
+{
+  size_t index = 0;
+  while (index + 1 < map.levelCount() && map.level(index + 1).cell_size <= resolution)
+  {
+    ++index;
+  }
+  return map.level(index);
+}
+}  // namespace
+
+void SignedDistanceField::query(const double p[3], double & distance, double gradient[3]) const
+{
+  const size_t n[3] = {nx, ny, nz};
+  size_t i[3];
+  double t[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    double u = (p[axis] - origin[axis]) / resolution;
+    u = std::clamp(u, 0.0, static_cast<double>(n[axis] - 1));
+    i[axis] = std::min(static_cast<size_t>(u), n[axis] > 1 ? n[axis] - 2 : 0);
+    t[axis] = n[axis] > 1 ? u - i[axis] : 0.0;
+  }
+  const size_t sx = n[1] * n[2];
+  const size_t sy = n[2];
+  const size_t dx = nx > 1 ? sx : 0;
+  const size_t dy = ny > 1 ? sy : 0;
+  const size_t dz = nz > 1 ? 1 : 0;
+  const float * c = values.data + i[0] * sx + i[1] * sy + i[2];
+
+  const double c000 = c[0], c001 = c[dz], c010 = c[dy], c011 = c[dy + dz];
+  const double c100 = c[dx], c101 = c[dx + dz], c110 = c[dx + dy], c111 = c[dx + dy + dz];
+
+  // Interpolate along z, then y, then x, keeping the partial derivatives
+  const double c00 = c000 + t[2] * (c001 - c000);
+  const double c01 = c010 + t[2] * (c011 - c010);
+  const double c10 = c100 + t[2] * (c101 - c100);
+  const double c11 = c110 + t[2] * (c111 - c110);
+  const double c0 = c00 + t[1] * (c01 - c00);
+  const double c1 = c10 + t[1] * (c11 - c10);
+  distance = c0 + t[0] * (c1 - c0);
+
+  const double dz00 = c001 - c000, dz01 = c011 - c010, dz10 = c101 - c100, dz11 = c111 - c110;
+  const double dz0 = dz00 + t[1] * (dz01 - dz00);
+  const double dz1 = dz10 + t[1] * (dz11 - dz10);
+  gradient[0] = (c1 - c0) / resolution;
+  gradient[1] = ((c01 - c00) + t[0] * ((c11 - c10) - (c01 - c00))) / resolution;
+  gradient[2] = (dz0 + t[0] * (dz1 - dz0)) / resolution;
+}
+
+void computeSignedDistanceField(const SurfaceMap & map, double resolution, double band,
+                                std::vector<float> & values, SignedDistanceField & field)
+{
+  field = SignedDistanceField();
+  values.clear();
+  if (map.point_cloud || map.rows() == 0 || map.cols() == 0)
+  {
+    return;
+  }
+
+  resolution = std::max(resolution, map.cell_size);
+  const SurfaceGrid & source = sourceLevel(map, resolution);
+
+  const auto z_range = std::minmax_element(map.z_values.begin(), map.z_values.end());
+  field.origin[0] = map.x_coordinates[0];
+  field.origin[1] = map.y_coordinates[0];
+  field.origin[2] = *z_range.first - band;
+  field.resolution = resolution;
+  field.band = band;
+  field.nx = static_cast<size_t>(
+               std::ceil((map.x_coordinates[map.rows() - 1] - field.origin[0]) / resolution)) + 1;
+  field.ny = static_cast<size_t>(
+               std::ceil((map.y_coordinates[map.cols() - 1] - field.origin[1]) / resolution)) + 1;
+  field.nz = static_cast<size_t>(
+               std::ceil((*z_range.second + band - field.origin[2]) / resolution)) + 1;
+  values.resize(field.nx * field.ny * field.nz);
+
+  const double band_squared = band * band;
+  for (size_t ix = 0; ix < field.nx; ++ix)
+  {
+    const double px = field.origin[0] + ix * resolution;
+    size_t x_first, x_last;
+    indexRange(source.x_coordinates, px - band, px + band, x_first, x_last);
+
+    for (size_t iy = 0; iy < field.ny; ++iy)
+    {
+      const double py = field.origin[1] + iy * resolution;
+      size_t y_first, y_last;
+      indexRange(source.y_coordinates, py - band, py + band, y_first, y_last);
+
+      // Height of the surface right below this column decides the sign
+      const size_t x_near = findClosestIndex(map.x_coordinates, px);
+      const size_t y_near = findClosestIndex(map.y_coordinates, py);
+      const double height = interpolate(map, map.z_values, x_near, y_near, px, py);
+
+      float * column = values.data() + (ix * field.ny + iy) * field.nz;
+      for (size_t iz = 0; iz < field.nz; ++iz)
+      {
+        const double pz = field.origin[2] + iz * resolution;
+        const double sign = pz >= height ? 1.0 : -1.0;
+        if (std::abs(pz - height) >= band)
+        {
+          column[iz] = sign * band;
+          continue;
+        }
+
+        // Nearest surface sample within the band
+        double best = band_squared;
+        for (size_t i = x_first; i < x_last; ++i)
+        {
+          const double ddx = source.x_coordinates[i] - px;
+          for (size_t j = y_first; j < y_last; ++j)
+          {
+            const double ddy = source.y_coordinates[j] - py;
+            const double ddz = source.z(i, j) - pz;
+            best = std::min(best, ddx * ddx + ddy * ddy + ddz * ddz);
+          }
+        }
+        // Between samples, the vertical distance to the interpolated surface
+        // can be the tighter bound
+        column[iz] = sign * std::min(std::sqrt(best), std::abs(pz - height));
+      }
+    }
+  }
+
+  field.values = values;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
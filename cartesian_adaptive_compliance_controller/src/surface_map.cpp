@@ -0,0 +1,598 @@
+#include <cartesian_adaptive_compliance_controller/data_reader.h>
+#include <cartesian_adaptive_compliance_controller/material_volume.h>
+#include <cartesian_adaptive_compliance_controller/point_cloud_surface.h>
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_image.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// Owned backing memory of maps that are read from text files
+struct SurfaceMapBuffers
+{
+  std::vector<double> x_coordinates;
+  std::vector<double> y_coordinates;
+  std::vector<double> z_values;
+  std::vector<double> stiffness_values;
+  std::vector<double> damping_values;
+  std::vector<uint8_t> material_ids;
+  std::vector<MaterialParameters> materials;
+};
+
+// Text files that surface_map_compiler turns into an image
+const char * const kSurfaceMapTextFiles[] = {"x.txt",         "y.txt",        "z.txt",
+                                             "stiffness.txt", "damping.txt",  "material.txt",
+                                             "materials.txt"};
+
+// True if a text file in \a directory was modified after \a image was written
+bool textFilesNewer(const std::string & directory, const struct stat & image)
+{
+  for (const char * name : kSurfaceMapTextFiles)
+  {
+    struct stat info;
+    if (stat((directory + "/" + name).c_str(), &info) == 0 &&
+        (info.st_mtim.tv_sec > image.st_mtim.tv_sec ||
+         (info.st_mtim.tv_sec == image.st_mtim.tv_sec &&
+          info.st_mtim.tv_nsec > image.st_mtim.tv_nsec)))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
+namespace
+{
+// Mean bucket occupancy of point cloud maps
+constexpr double kPointsPerBucket = 4.0;
+
+bool loadPointCloud(const std::string & directory, double z_offset, SurfaceMap & map,
+                    std::string & error)
+{
+  std::vector<double> values;
+  DataReaderTiming timing;
+  if (!pointCloudReader(directory + "/points.txt", values, timing, error))
+  {
+    return false;
+  }
+
+  std::vector<SurfacePoint> points(values.size() / 5);
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    const double * v = &values[5 * i];
+    points[i] = {v[0], v[1], v[2] + z_offset, v[3], v[4]};
+  }
+  values = std::vector<double>();
+
+  auto cloud = std::make_shared<PointCloudSurface>();
+  if (!cloud->build(std::move(points), kPointsPerBucket, error))
+  {
+    error = directory + ": " + error;
+    return false;
+  }
+  map = SurfaceMap();
+  map.source = directory;
+  map.load_report = formatTimings({timing});
+  map.point_cloud = cloud;
+  return true;
+}
+
+// Whether the controller can compute forces with it
+bool isValidMaterial(const MaterialParameters & m)
+{
+  return std::isfinite(m.stiffness) && std::isfinite(m.damping) && std::isfinite(m.exponent) &&
+         std::isfinite(m.max_penetration) && std::isfinite(m.min_force) && m.stiffness >= 0.0 &&
+         m.damping >= 0.0 && m.exponent > 0.0 && m.max_penetration > 0.0;
+}
+
+// Turns the numbers of material.txt and materials.txt into IDs and a table
+bool convertMaterials(const std::string & directory, const std::vector<double> & ids,
+                      const std::vector<double> & table, SurfaceMapBuffers & buffers,
+                      std::string & error)
+{
+  std::vector<char> defined(kMaxMaterials, 0);
+  buffers.materials.assign(kMaxMaterials, MaterialParameters());
+  for (size_t i = 0; i < table.size(); i += kMaterialFields)
+  {
+    const double * v = &table[i];
+    const MaterialParameters material = {v[1], v[2], v[3], v[4], v[5]};
+    if (!(v[0] >= 0.0 && v[0] < kMaxMaterials) || v[0] != std::floor(v[0]) ||
+        defined[static_cast<size_t>(v[0])] || !isValidMaterial(material))
+    {
+      error = directory + "/materials.txt: invalid or repeated material in line " +
+              std::to_string(i / kMaterialFields + 1);
+      return false;
+    }
+    defined[static_cast<size_t>(v[0])] = 1;
+    buffers.materials[static_cast<size_t>(v[0])] = material;
+  }
+
+  buffers.material_ids.resize(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    const double id = ids[i];
+    if (!(id >= 0.0 && id < kMaxMaterials) || !defined[static_cast<size_t>(id)] ||
+        id != std::floor(id))
+    {
+      error = directory + "/material.txt: cell " + std::to_string(i + 1) +
+              " has no material in materials.txt";
+      return false;
+    }
+    buffers.material_ids[i] = static_cast<uint8_t>(id);
+  }
+  return true;
+}
+}  // namespace
+
+bool sampleSurface(const SurfaceMap & map, double x, double y, double travel,
+                   SurfaceCursor & cursor, SurfaceSample & sample)
+{
+  sample.dz_dt = 0.0;
+  sample.material = nullptr;
+  if (map.point_cloud)
+  {
+    return map.point_cloud->sample(x, y, sample);
+  }
+
+  const size_t level = map.selectLevel(travel);
+  const SurfaceGrid & grid = map.level(level);
+  if (cursor.map != &map)
+  {
+    // Hints into another map are worthless, search globally
+    cursor.map = &map;
+    cursor.level = level;
+    cursor.x_index = grid.rows();
+    cursor.y_index = grid.cols();
+  }
+  else if (cursor.level != level)
+  {
+    // Each level halves the resolution of the one before
+    const int shift = static_cast<int>(cursor.level) - static_cast<int>(level);
+    cursor.x_index = shift > 0 ? cursor.x_index << shift : cursor.x_index >> -shift;
+    cursor.y_index = shift > 0 ? cursor.y_index << shift : cursor.y_index >> -shift;
+    cursor.level = level;
+  }
+  size_t x_index = cursor.x_index < grid.rows()
+                     ? findClosestIndex(grid.x_coordinates, x, cursor.x_index)
+                     : findClosestIndex(grid.x_coordinates, x);
+  size_t y_index = cursor.y_index < grid.cols()
+                     ? findClosestIndex(grid.y_coordinates, y, cursor.y_index)
+                     : findClosestIndex(grid.y_coordinates, y);
+  cursor.x_index = x_index;
+  cursor.y_index = y_index;
+  sample.z = grid.z(x_index, y_index);
+  sample.stiffness = grid.stiffness(x_index, y_index);
+  sample.damping = grid.damping(x_index, y_index);
+  if (grid.hasMaterials())
+  {
+    sample.material = &grid.material(x_index, y_index);
+  }
+  sample.dz_dx = interpolate(grid, grid.dz_dx_values, x_index, y_index, x, y);
+  sample.dz_dy = interpolate(grid, grid.dz_dy_values, x_index, y_index, x, y);
+  return true;
+}
+
+bool readSurfaceMapText(const std::string & directory, double z_offset, SurfaceMap & map,
+                        std::string & error)
+{
+  if (std::ifstream(directory + "/points.txt").good())
+  {
+    return loadPointCloud(directory, z_offset, map, error);
+  }
+
+  auto buffers = std::make_shared<SurfaceMapBuffers>();
+  std::vector<DataReaderTiming> timings;
+  const bool has_materials = std::ifstream(directory + "/materials.txt").good();
+  if (has_materials)
+  {
+    std::vector<double> ids;
+    std::vector<double> table;
+    if (!materialMapReader(directory, buffers->x_coordinates, buffers->y_coordinates,
+                           buffers->z_values, ids, table, timings, error) ||
+        !convertMaterials(directory, ids, table, *buffers, error))
+    {
+      return false;
+    }
+  }
+  else if (!dataReader(directory, buffers->x_coordinates, buffers->y_coordinates,
+                       buffers->z_values, buffers->stiffness_values, buffers->damping_values,
+                       timings, error))
+  {
+    return false;
+  }
+  for (double & z : buffers->z_values)
+  {
+    z += z_offset;
+  }
+
+  map = SurfaceMap();
+  map.source = directory;
+  map.load_report = formatTimings(timings);
+  map.x_coordinates = buffers->x_coordinates;
+  map.y_coordinates = buffers->y_coordinates;
+  map.z_values = buffers->z_values;
+  map.stiffness_values = buffers->stiffness_values;
+  map.damping_values = buffers->damping_values;
+  map.material_ids = buffers->material_ids;
+  map.materials = buffers->materials;
+  map.storage = buffers;
+  if (!validateSurfaceMap(map, error))
+  {
+    return false;
+  }
+  computeDerivedFields(map);
+  return true;
+}
+
+bool loadSurfaceMap(const std::string & directory, SurfaceMap & map, std::string & error)
+{
+  struct stat info;
+  std::string volume_directory = directory + "/";
+  bool loaded;
+  if (stat(directory.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+  {
+    volume_directory = directory.substr(0, directory.find_last_of('/') + 1);
+    volume_directory = volume_directory.empty() ? "./" : volume_directory;
+    loaded = loadSurfaceMapImage(directory, map, error);
+  }
+  else if (stat((directory + "/" + kSurfaceMapImageName).c_str(), &info) == 0 &&
+           !textFilesNewer(directory, info))
+  {
+    loaded = loadSurfaceMapImage(directory + "/" + kSurfaceMapImageName, map, error);
+  }
+  else if (stat((directory + "/" + kSurfaceMapImageName).c_str(), &info) == 0)
+  {
+    // The text files were edited since the image was compiled
+    loaded = readSurfaceMapText(directory, kScanZOffset, map, error);
+    map.load_report += std::string(kSurfaceMapImageName) +
+                       " is older than the text files and was ignored, recompile it\n";
+  }
+  else
+  {
+    loaded = readSurfaceMapText(directory, kScanZOffset, map, error);
+  }
+  if (!loaded)
+  {
+    return false;
+  }
+
+  const std::string volume_file = volume_directory + kMaterialVolumeName;
+  if (stat(volume_file.c_str(), &info) == 0)
+  {
+    auto volume = std::make_shared<MaterialVolume>();
+    if (!readMaterialVolume(volume_file, *volume, map.load_report, error))
+    {
+      return false;
+    }
+    map.material_volume = volume;
+  }
+  return true;
+}
+
+void computeSurfaceGradients(const SurfaceGrid & grid, std::vector<double> & dz_dx,
+                             std::vector<double> & dz_dy)
+{
+  const size_t n = grid.rows();
+  const size_t m = grid.cols();
+  dz_dx.assign(n * m, 0.0);
+  dz_dy.assign(n * m, 0.0);
+
+  auto slope = [](double z0, double z1, double c0, double c1) {
+    return c1 != c0 ? (z1 - z0) / (c1 - c0) : 0.0;
+  };
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const size_t i0 = i > 0 ? i - 1 : i;
+    const size_t i1 = i + 1 < n ? i + 1 : i;
+    for (size_t j = 0; j < m; ++j)
+    {
+      const size_t j0 = j > 0 ? j - 1 : j;
+      const size_t j1 = j + 1 < m ? j + 1 : j;
+      dz_dx[grid.cellIndex(i, j)] =
+        slope(grid.z(i0, j), grid.z(i1, j), grid.x_coordinates[i0], grid.x_coordinates[i1]);
+      dz_dy[grid.cellIndex(i, j)] =
+        slope(grid.z(i, j0), grid.z(i, j1), grid.y_coordinates[j0], grid.y_coordinates[j1]);
+    }
+  }
+}
+
+namespace
+{
+// Owned backing memory of one coarse pyramid level
+struct LevelBuffers
+{
+  std::vector<double> x_coordinates;
+  std::vector<double> y_coordinates;
+  std::vector<double> z_values;
+  std::vector<double> stiffness_values;
+  std::vector<double> damping_values;
+  std::vector<double> dz_dx_values;
+  std::vector<double> dz_dy_values;
+  std::vector<uint8_t> material_ids;
+};
+
+// Keeps the fields we derive from alive together with the derived ones
+struct DerivedBuffers
+{
+  std::shared_ptr<const void> base;
+  std::vector<double> dz_dx_values;
+  std::vector<double> dz_dy_values;
+  std::vector<LevelBuffers> levels;
+  std::vector<float> distance_values;
+};
+
+double cellSize(const SurfaceGrid & grid)
+{
+  auto spacing = [](ArrayView<double> c) {
+    return c.size > 1 ? std::abs(c[c.size - 1] - c[0]) / (c.size - 1) : 0.0;
+  };
+  return std::max(spacing(grid.x_coordinates), spacing(grid.y_coordinates));
+}
+
+// Halves the resolution of each axis by averaging pairs of samples
+std::vector<double> halve(ArrayView<double> coordinates)
+{
+  std::vector<double> result((coordinates.size + 1) / 2);
+  for (size_t i = 0; i < result.size(); ++i)
+  {
+    const size_t i1 = std::min(2 * i + 1, coordinates.size - 1);
+    result[i] = 0.5 * (coordinates[2 * i] + coordinates[i1]);
+  }
+  return result;
+}
+
+std::vector<double> halve(const SurfaceGrid & fine, ArrayView<double> field)
+{
+  const size_t n = (fine.rows() + 1) / 2;
+  const size_t m = (fine.cols() + 1) / 2;
+  std::vector<double> result(n * m);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const size_t i1 = std::min(2 * i + 1, fine.rows() - 1);
+    for (size_t j = 0; j < m; ++j)
+    {
+      const size_t j1 = std::min(2 * j + 1, fine.cols() - 1);
+      result[i * m + j] =
+        0.25 * (field[fine.cellIndex(2 * i, 2 * j)] + field[fine.cellIndex(2 * i, j1)] +
+                field[fine.cellIndex(i1, 2 * j)] + field[fine.cellIndex(i1, j1)]);
+    }
+  }
+  return result;
+}
+
+// Each coarse cell takes the material that covers most of its 2x2 block
+std::vector<uint8_t> halve(const SurfaceGrid & fine, ArrayView<uint8_t> ids)
+{
+  const size_t n = (fine.rows() + 1) / 2;
+  const size_t m = (fine.cols() + 1) / 2;
+  std::vector<uint8_t> result(n * m);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const size_t i1 = std::min(2 * i + 1, fine.rows() - 1);
+    for (size_t j = 0; j < m; ++j)
+    {
+      const size_t j1 = std::min(2 * j + 1, fine.cols() - 1);
+      const uint8_t block[4] = {ids[fine.cellIndex(2 * i, 2 * j)], ids[fine.cellIndex(2 * i, j1)],
+                                ids[fine.cellIndex(i1, 2 * j)], ids[fine.cellIndex(i1, j1)]};
+      size_t best = 0;
+      for (size_t k = 1; k < 4; ++k)
+      {
+        if (std::count(block, block + 4, block[k]) > std::count(block, block + 4, block[best]))
+        {
+          best = k;
+        }
+      }
+      result[i * m + j] = block[best];
+    }
+  }
+  return result;
+}
+
+SurfaceGrid viewLevel(const LevelBuffers & buffers, ArrayView<MaterialParameters> materials)
+{
+  SurfaceGrid grid;
+  grid.x_coordinates = buffers.x_coordinates;
+  grid.y_coordinates = buffers.y_coordinates;
+  grid.z_values = buffers.z_values;
+  grid.stiffness_values = buffers.stiffness_values;
+  grid.damping_values = buffers.damping_values;
+  grid.dz_dx_values = buffers.dz_dx_values;
+  grid.dz_dy_values = buffers.dz_dy_values;
+  if (!buffers.material_ids.empty())
+  {
+    grid.material_ids = buffers.material_ids;
+    grid.materials = materials;
+  }
+  grid.cell_size = cellSize(grid);
+  return grid;
+}
+}  // namespace
+
+void computeDerivedFields(SurfaceMap & map)
+{
+  auto buffers = std::make_shared<DerivedBuffers>();
+  buffers->base = map.storage;
+
+  map.cell_size = cellSize(map);
+  if (map.dz_dx_values.empty() || map.dz_dy_values.empty())
+  {
+    computeSurfaceGradients(map, buffers->dz_dx_values, buffers->dz_dy_values);
+    map.dz_dx_values = buffers->dz_dx_values;
+    map.dz_dy_values = buffers->dz_dy_values;
+  }
+
+  if (map.levels.empty())
+  {
+    // Views into the buffers must stay valid while we append
+    buffers->levels.reserve(kMaxSurfaceMapLevels);
+    map.levels.reserve(kMaxSurfaceMapLevels);
+    const SurfaceGrid * fine = &map;
+    while (map.levelCount() < kMaxSurfaceMapLevels && fine->rows() > 1 && fine->cols() > 1)
+    {
+      buffers->levels.emplace_back();
+      LevelBuffers & level = buffers->levels.back();
+      level.x_coordinates = halve(fine->x_coordinates);
+      level.y_coordinates = halve(fine->y_coordinates);
+      level.z_values = halve(*fine, fine->z_values);
+      if (fine->hasMaterials())
+      {
+        level.material_ids = halve(*fine, fine->material_ids);
+      }
+      else
+      {
+        level.stiffness_values = halve(*fine, fine->stiffness_values);
+        level.damping_values = halve(*fine, fine->damping_values);
+      }
+
+      // Slopes of the smoothed surface, not averages of the fine slopes
+      SurfaceGrid coarse = viewLevel(level, map.materials);
+      computeSurfaceGradients(coarse, level.dz_dx_values, level.dz_dy_values);
+
+      map.levels.push_back(viewLevel(level, map.materials));
+      fine = &map.levels.back();
+    }
+  }
+  else
+  {
+    buffers->levels.reserve(map.levels.size());
+    for (SurfaceGrid & level : map.levels)
+    {
+      level.cell_size = cellSize(level);
+      if (level.dz_dx_values.empty() || level.dz_dy_values.empty())
+      {
+        buffers->levels.emplace_back();
+        LevelBuffers & gradients = buffers->levels.back();
+        computeSurfaceGradients(level, gradients.dz_dx_values, gradients.dz_dy_values);
+        level.dz_dx_values = gradients.dz_dx_values;
+        level.dz_dy_values = gradients.dz_dy_values;
+      }
+    }
+  }
+
+  if (!map.distance_field)
+  {
+    auto distance_field = std::make_shared<SignedDistanceField>();
+    computeSignedDistanceField(map, kDistanceFieldResolution, kDistanceFieldBand,
+                               buffers->distance_values, *distance_field);
+    map.distance_field = distance_field;
+  }
+
+  map.storage = buffers;
+}
+
+namespace
+{
+bool validateGrid(const SurfaceGrid & grid, const std::string & name, std::string & error)
+{
+  if (grid.rows() == 0 || grid.cols() == 0)
+  {
+    error = name + " has no grid coordinates";
+    return false;
+  }
+
+  auto check_ascending = [&](ArrayView<double> coordinates, const char * axis) {
+    for (size_t i = 0; i < coordinates.size; ++i)
+    {
+      if (!std::isfinite(coordinates[i]) || (i > 0 && coordinates[i] <= coordinates[i - 1]))
+      {
+        error = name + ": " + axis + " coordinates are not strictly ascending at index " +
+                std::to_string(i);
+        return false;
+      }
+    }
+    return true;
+  };
+  if (!check_ascending(grid.x_coordinates, "x") || !check_ascending(grid.y_coordinates, "y"))
+  {
+    return false;
+  }
+
+  const size_t cells = grid.rows() * grid.cols();
+  auto check = [&](ArrayView<double> field, const char * field_name) {
+    if (field.size != cells)
+    {
+      error = name + ": " + field_name + " has " + std::to_string(field.size) +
+              " values, expected " + std::to_string(grid.rows()) + " x " +
+              std::to_string(grid.cols());
+      return false;
+    }
+    for (double value : field)
+    {
+      if (!std::isfinite(value))
+      {
+        error = name + ": " + field_name + " contains non-finite values";
+        return false;
+      }
+    }
+    return true;
+  };
+
+  auto check_optional = [&](ArrayView<double> field, const char * field_name) {
+    return field.empty() || check(field, field_name);
+  };
+
+  if (grid.hasMaterials())
+  {
+    if (grid.material_ids.size != cells || grid.materials.size != kMaxMaterials)
+    {
+      error = name + ": material IDs do not match the grid or the material table is incomplete";
+      return false;
+    }
+
+    // Images and shared maps come without the checks of materials.txt
+    bool used[kMaxMaterials] = {};
+    for (uint8_t id : grid.material_ids)
+    {
+      used[id] = true;
+    }
+    for (size_t id = 0; id < kMaxMaterials; ++id)
+    {
+      if (used[id] && !isValidMaterial(grid.materials[id]))
+      {
+        error = name + ": material " + std::to_string(id) + " has invalid parameters";
+        return false;
+      }
+    }
+  }
+  else if (!check(grid.stiffness_values, "stiffness") || !check(grid.damping_values, "damping"))
+  {
+    return false;
+  }
+  return check(grid.z_values, "z") && check_optional(grid.dz_dx_values, "dz/dx") &&
+         check_optional(grid.dz_dy_values, "dz/dy");
+}
+}  // namespace
+
+bool validateSurfaceMap(const SurfaceMap & map, std::string & error)
+{
+  if (map.point_cloud)
+  {
+    // Validated while it was built
+    return true;
+  }
+  if (!validateGrid(map, "Surface map " + map.source, error))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < map.levels.size(); ++i)
+  {
+    if (!validateGrid(map.levels[i], "Pyramid level " + std::to_string(i + 1), error))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
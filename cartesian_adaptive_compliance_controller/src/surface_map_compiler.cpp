@@ -0,0 +1,174 @@
+// Turns the MATLAB text files of a surface map into the binary runtime format.
+//
+// Usage: surface_map_compiler [--check] [--z-offset <m>] <map_directory> [output]
+//
+// The files are validated, the z offset of the scans is applied, and the
+// gradients, pyramid and signed distance field are computed once here
+// instead of at every controller start. The image is written to
+// <map_directory>/surface_map.smap unless another output is given, and
+// controllers pick it up in place of the text files.
+//
+// With --check, the map is only validated and its statistics printed.
+
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace cartesian_adaptive_compliance_controller;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+void printRange(const char * name, ArrayView<double> values, const char * unit)
+{
+  const auto range = std::minmax_element(values.begin(), values.end());
+  double mean = 0.0;
+  for (double v : values)
+  {
+    mean += v / values.size;
+  }
+  std::cout << "  " << name << ": " << *range.first << " .. " << *range.second << " " << unit
+            << ", mean " << mean << "\n";
+}
+
+void printStatistics(const SurfaceMap & map)
+{
+  std::cout << "grid:           " << map.rows() << " x " << map.cols() << " cells of "
+            << map.cell_size * 1e3 << " mm\n";
+  printRange("x        ", map.x_coordinates, "m");
+  printRange("y        ", map.y_coordinates, "m");
+  printRange("z        ", map.z_values, "m");
+  if (map.hasMaterials())
+  {
+    std::vector<size_t> cells(kMaxMaterials, 0);
+    for (uint8_t id : map.material_ids)
+    {
+      ++cells[id];
+    }
+    for (size_t id = 0; id < kMaxMaterials; ++id)
+    {
+      if (cells[id] > 0)
+      {
+        const MaterialParameters & m = map.materials[id];
+        std::cout << "  material " << id << ": " << cells[id] << " cells, stiffness "
+                  << m.stiffness << " N/m, damping " << m.damping << " Ns/m, exponent "
+                  << m.exponent << ", max penetration " << m.max_penetration
+                  << " m, min force " << m.min_force << " N\n";
+      }
+    }
+  }
+  else
+  {
+    printRange("stiffness", map.stiffness_values, "N/m");
+    printRange("damping  ", map.damping_values, "Ns/m");
+  }
+  printRange("dz/dx    ", map.dz_dx_values, "");
+  printRange("dz/dy    ", map.dz_dy_values, "");
+
+  std::cout << "pyramid levels: " << map.levelCount() << "\n";
+  for (size_t l = 1; l < map.levelCount(); ++l)
+  {
+    std::cout << "  level " << l << ": " << map.level(l).rows() << " x " << map.level(l).cols()
+              << " cells of " << map.level(l).cell_size * 1e3 << " mm\n";
+  }
+
+  const SignedDistanceField & field = *map.distance_field;
+  std::cout << "distance field: " << field.nx << " x " << field.ny << " x " << field.nz
+            << " voxels of " << field.resolution * 1e3 << " mm, "
+            << field.values.size * sizeof(float) / 1048576.0 << " MiB\n";
+}
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  bool check_only = false;
+  double z_offset = kScanZOffset;
+  std::string directory;
+  std::string output;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string argument = argv[i];
+    if (argument == "--check")
+    {
+      check_only = true;
+    }
+    else if (argument == "--z-offset" && i + 1 < argc)
+    {
+      z_offset = std::strtod(argv[++i], nullptr);
+    }
+    else if (directory.empty())
+    {
+      directory = argument;
+    }
+    else if (output.empty())
+    {
+      output = argument;
+    }
+    else
+    {
+      directory.clear();
+      break;
+    }
+  }
+  if (directory.empty())
+  {
+    std::cerr << "Usage: " << argv[0] << " [--check] [--z-offset <m>] <map_directory> [output]"
+              << std::endl;
+    return 1;
+  }
+  if (output.empty())
+  {
+    output = directory + "/" + kSurfaceMapImageName;
+  }
+
+  // Everything is validated while the map is read
+  SurfaceMap map;
+  std::string error;
+  auto start = Clock::now();
+  if (!readSurfaceMapText(directory, z_offset, map, error))
+  {
+    std::cerr << "Invalid surface map: " << error << std::endl;
+    return 1;
+  }
+  if (map.point_cloud)
+  {
+    std::cerr << "Point cloud maps cannot be compiled" << std::endl;
+    return 1;
+  }
+  const double compile_time = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::cout << map.load_report;
+  std::cout << "z offset:       " << z_offset << " m\n";
+  printStatistics(map);
+  std::cout << "compile time:   " << compile_time << " s" << std::endl;
+  if (check_only)
+  {
+    return 0;
+  }
+
+  if (!saveSurfaceMapImage(output, map, error))
+  {
+    std::cerr << "Failed to write surface map: " << error << std::endl;
+    return 1;
+  }
+
+  // Read the image back as the controller will
+  SurfaceMap compiled;
+  start = Clock::now();
+  if (!loadSurfaceMapImage(output, compiled, error))
+  {
+    std::cerr << "Written surface map does not load: " << error << std::endl;
+    return 1;
+  }
+  const double load_time = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << "wrote " << output << ", " << surfaceMapImageSize(map) / 1048576.0 << " MiB, "
+            << "loads in " << load_time * 1e3 << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,399 @@
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_image.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+using namespace surface_map_image;
+
+size_t alignUp(size_t value)
+{
+  return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// The sections of a map in image order
+struct SectionSource
+{
+  SectionId id;
+  uint16_t level;
+  const void * data;
+  uint16_t element_size;
+  size_t count;
+
+  SectionSource() = default;
+  template <typename T>
+  SectionSource(SectionId i, uint16_t l, ArrayView<T> values)
+  : id(i), level(l), data(values.data), element_size(sizeof(T)), count(values.size)
+  {
+  }
+  size_t bytes() const { return count * element_size; }
+};
+
+// Layout of the signed distance field: origin, resolution, band and size
+constexpr size_t kDistanceFieldGridSize = 8;
+
+size_t sectionsOf(const SurfaceMap & map, SectionSource (&sections)[kMaxSections],
+                  double (&distance_field_grid)[kDistanceFieldGridSize])
+{
+  size_t count = 0;
+  for (uint16_t level = 0; level < map.levelCount(); ++level)
+  {
+    const SurfaceGrid & grid = map.level(level);
+    sections[count++] = {SectionId::XCoordinates, level, grid.x_coordinates};
+    sections[count++] = {SectionId::YCoordinates, level, grid.y_coordinates};
+    sections[count++] = {SectionId::Z, level, grid.z_values};
+    if (grid.hasMaterials())
+    {
+      // Readers without material support reject the map, as it has no stiffness
+      sections[count++] = {SectionId::MaterialIds, level, grid.material_ids};
+    }
+    else
+    {
+      sections[count++] = {SectionId::Stiffness, level, grid.stiffness_values};
+      sections[count++] = {SectionId::Damping, level, grid.damping_values};
+    }
+    if (!grid.dz_dx_values.empty())
+    {
+      sections[count++] = {SectionId::DzDx, level, grid.dz_dx_values};
+      sections[count++] = {SectionId::DzDy, level, grid.dz_dy_values};
+    }
+  }
+
+  if (map.hasMaterials())
+  {
+    sections[count++] = {SectionId::Materials, 0, map.materials};
+  }
+
+  const SignedDistanceField * field = map.distance_field.get();
+  if (field != nullptr && !field->empty())
+  {
+    const double grid[kDistanceFieldGridSize] = {
+      field->origin[0], field->origin[1], field->origin[2], field->resolution,
+      field->band,      double(field->nx), double(field->ny), double(field->nz)};
+    std::copy(grid, grid + kDistanceFieldGridSize, distance_field_grid);
+    sections[count++] = {SectionId::DistanceFieldGrid, 0,
+                         ArrayView<double>(distance_field_grid, kDistanceFieldGridSize)};
+    sections[count++] = {SectionId::DistanceField, 0, field->values};
+  }
+  return count;
+}
+
+// Element size that readers of this version expect, 0 for unknown sections
+size_t expectedElementSize(uint32_t id)
+{
+  switch (static_cast<SectionId>(id))
+  {
+    case SectionId::XCoordinates:
+    case SectionId::YCoordinates:
+    case SectionId::Z:
+    case SectionId::Stiffness:
+    case SectionId::Damping:
+    case SectionId::DzDx:
+    case SectionId::DzDy:
+    case SectionId::DistanceFieldGrid:
+      return sizeof(double);
+    case SectionId::DistanceField:
+      return sizeof(float);
+    case SectionId::MaterialIds:
+      return sizeof(uint8_t);
+    case SectionId::Materials:
+      return sizeof(MaterialParameters);
+  }
+  return 0;
+}
+
+// Restores the distance field of an image, false if the sections do not fit together
+bool viewDistanceField(ArrayView<double> grid, ArrayView<float> values, SurfaceMap & map)
+{
+  if (grid.empty() && values.empty())
+  {
+    return true;
+  }
+  if (grid.size != kDistanceFieldGridSize)
+  {
+    return false;
+  }
+  auto field = std::make_shared<SignedDistanceField>();
+  field->origin[0] = grid[0];
+  field->origin[1] = grid[1];
+  field->origin[2] = grid[2];
+  field->resolution = grid[3];
+  field->band = grid[4];
+  field->nx = static_cast<size_t>(grid[5]);
+  field->ny = static_cast<size_t>(grid[6]);
+  field->nz = static_cast<size_t>(grid[7]);
+  if (!(field->resolution > 0.0) || field->nx * field->ny * field->nz != values.size)
+  {
+    return false;
+  }
+  field->values = values;
+  map.distance_field = field;
+  return true;
+}
+}  // namespace
+
+size_t surfaceMapImageSize(const SurfaceMap & map)
+{
+  SectionSource sections[kMaxSections];
+  double distance_field_grid[kDistanceFieldGridSize];
+  size_t count = sectionsOf(map, sections, distance_field_grid);
+
+  size_t size = alignUp(sizeof(Header));
+  for (size_t i = 0; i < count; ++i)
+  {
+    size += alignUp(sections[i].bytes());
+  }
+  return size;
+}
+
+void writeSurfaceMapImage(const SurfaceMap & map, uint64_t generation, void * buffer)
+{
+  SectionSource sections[kMaxSections];
+  double distance_field_grid[kDistanceFieldGridSize];
+  size_t count = sectionsOf(map, sections, distance_field_grid);
+
+  auto bytes = static_cast<uint8_t *>(buffer);
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.generation = generation;
+  header.rows = map.rows();
+  header.cols = map.cols();
+  header.section_count = count;
+
+  size_t offset = alignUp(sizeof(Header));
+  for (size_t i = 0; i < count; ++i)
+  {
+    const size_t length = sections[i].bytes();
+    header.sections[i] = {static_cast<uint32_t>(sections[i].id), sections[i].element_size,
+                          sections[i].level, offset, sections[i].count};
+    if (length > 0)
+    {
+      std::memcpy(bytes + offset, sections[i].data, length);
+    }
+    offset += alignUp(length);
+  }
+  header.total_size = offset;
+  std::memcpy(bytes, &header, sizeof(header));
+}
+
+bool viewSurfaceMapImage(const void * buffer, size_t size, std::shared_ptr<const void> storage,
+                         SurfaceMap & map, std::string & error)
+{
+  if (size < sizeof(Header))
+  {
+    error = "Surface map image is truncated";
+    return false;
+  }
+  auto bytes = static_cast<const uint8_t *>(buffer);
+  auto header = static_cast<const Header *>(buffer);
+  if (header->magic != kMagic || header->version < kMinVersion || header->version > kVersion)
+  {
+    error = "Not a surface map image or unsupported version";
+    return false;
+  }
+  if (header->total_size > size || header->section_count > kMaxSections)
+  {
+    error = "Surface map image is truncated";
+    return false;
+  }
+
+  map = SurfaceMap();
+  map.generation = header->generation;
+  ArrayView<double> distance_field_grid;
+  ArrayView<float> distance_field_values;
+  ArrayView<MaterialParameters> materials;
+  for (size_t i = 0; i < header->section_count; ++i)
+  {
+    const Section & section = header->sections[i];
+    const size_t expected_size = expectedElementSize(section.id);
+    if (section.element_size == 0 ||
+        (expected_size != 0 && section.element_size != expected_size) ||
+        section.offset % kAlignment != 0 || section.offset > header->total_size ||
+        section.count > (header->total_size - section.offset) / section.element_size ||
+        section.level >= kMaxSurfaceMapLevels)
+    {
+      error = "Surface map image has a corrupt section table";
+      return false;
+    }
+    if (section.level > map.levels.size())
+    {
+      map.levels.resize(section.level);
+    }
+    SurfaceGrid & grid = section.level == 0 ? map : map.levels[section.level - 1];
+
+    ArrayView<double> values(reinterpret_cast<const double *>(bytes + section.offset),
+                             section.count);
+    switch (static_cast<SectionId>(section.id))
+    {
+      case SectionId::XCoordinates:
+        grid.x_coordinates = values;
+        break;
+      case SectionId::YCoordinates:
+        grid.y_coordinates = values;
+        break;
+      case SectionId::Z:
+        grid.z_values = values;
+        break;
+      case SectionId::Stiffness:
+        grid.stiffness_values = values;
+        break;
+      case SectionId::Damping:
+        grid.damping_values = values;
+        break;
+      case SectionId::DzDx:
+        grid.dz_dx_values = values;
+        break;
+      case SectionId::DzDy:
+        grid.dz_dy_values = values;
+        break;
+      case SectionId::DistanceFieldGrid:
+        distance_field_grid = values;
+        break;
+      case SectionId::DistanceField:
+        distance_field_values = ArrayView<float>(
+          reinterpret_cast<const float *>(bytes + section.offset), section.count);
+        break;
+      case SectionId::MaterialIds:
+        grid.material_ids = ArrayView<uint8_t>(bytes + section.offset, section.count);
+        break;
+      case SectionId::Materials:
+        materials = ArrayView<MaterialParameters>(
+          reinterpret_cast<const MaterialParameters *>(bytes + section.offset), section.count);
+        break;
+      default:
+        // Sections from newer writers are skipped
+        break;
+    }
+  }
+  for (size_t l = 0; l < map.levelCount(); ++l)
+  {
+    SurfaceGrid & grid = l == 0 ? static_cast<SurfaceGrid &>(map) : map.levels[l - 1];
+    if (grid.hasMaterials())
+    {
+      grid.materials = materials;
+    }
+  }
+  if (map.rows() != header->rows || map.cols() != header->cols)
+  {
+    error = "Surface map image dimensions do not match its coordinates";
+    return false;
+  }
+  if (!viewDistanceField(distance_field_grid, distance_field_values, map))
+  {
+    error = "Surface map image has an inconsistent distance field";
+    return false;
+  }
+  map.storage = std::move(storage);
+  if (!validateSurfaceMap(map, error))
+  {
+    return false;
+  }
+  computeDerivedFields(map);
+  return true;
+}
+
+bool loadSurfaceMapImage(const std::string & filename, SurfaceMap & map, std::string & error)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    error = "Cannot open " + filename + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    error = "Cannot read " + filename;
+    close(fd);
+    return false;
+  }
+  const size_t size = info.st_size;
+  void * memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    error = "Cannot map " + filename + ": " + std::strerror(errno);
+    return false;
+  }
+
+  std::shared_ptr<const void> mapping(memory, [size](const void * p) {
+    munmap(const_cast<void *>(p), size);
+  });
+  if (!viewSurfaceMapImage(memory, size, mapping, map, error))
+  {
+    error = filename + ": " + error;
+    return false;
+  }
+  map.source = filename;
+  return true;
+}
+
+bool saveSurfaceMapImage(const std::string & filename, const SurfaceMap & map,
+                         std::string & error)
+{
+  if (map.point_cloud || map.quantized())
+  {
+    error = "Only maps with double grid fields can be saved";
+    return false;
+  }
+
+  const size_t size = surfaceMapImageSize(map);
+  std::unique_ptr<void, decltype(&std::free)> buffer(std::aligned_alloc(kAlignment, size),
+                                                     &std::free);
+  if (!buffer)
+  {
+    error = "Out of memory";
+    return false;
+  }
+  writeSurfaceMapImage(map, map.generation, buffer.get());
+
+  // Controllers that load the file at the same time never see half of it
+  const std::string temporary = filename + ".tmp";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    error = "Cannot create " + temporary + ": " + std::strerror(errno);
+    return false;
+  }
+  auto bytes = static_cast<const uint8_t *>(buffer.get());
+  size_t written = 0;
+  while (written < size)
+  {
+    const ssize_t n = write(fd, bytes + written, size - written);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      error = "Cannot write " + temporary + ": " + std::strerror(errno);
+      close(fd);
+      unlink(temporary.c_str());
+      return false;
+    }
+    written += n;
+  }
+  if (fsync(fd) != 0 || close(fd) != 0 || rename(temporary.c_str(), filename.c_str()) != 0)
+  {
+    error = "Cannot write " + filename + ": " + std::strerror(errno);
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,295 @@
+#include <cartesian_adaptive_compliance_controller/surface_map_learner.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// How often the estimator drains the observations
+constexpr auto kEstimatePeriod = std::chrono::milliseconds(1);
+
+// Standard deviation of the force measurements, typical of F/T sensors.
+// Observations are weighted by it.
+constexpr double kForceNoise = 0.1;
+
+// Shallower contacts carry too little force to tell stiffness from noise
+constexpr double kMinPenetration = 1e-4;
+
+// Initial uncertainty of the map's height, and the largest learned offset
+constexpr double kHeightUncertainty = 0.001;
+constexpr double kMaxHeightOffset = 0.005;
+
+// Lower bound of stiffness^(1/exponent), keeps the height offset finite
+constexpr double kMinRoot = 1e-3;
+}  // namespace
+
+SurfaceMapLearner::SurfaceMapLearner()
+: m_forgetting(1.0),
+  m_x_hint(0),
+  m_y_hint(0),
+  m_worker_x_hint(0),
+  m_worker_y_hint(0),
+  m_learned_count(0),
+  m_dropped(0),
+  m_stop(false)
+{
+}
+
+SurfaceMapLearner::~SurfaceMapLearner()
+{
+  stop();
+}
+
+bool SurfaceMapLearner::start(const SurfaceGrid & grid, double forgetting)
+{
+  stop();
+  if (grid.rows() == 0 || grid.cols() == 0)
+  {
+    return false;
+  }
+  m_x_coordinates.assign(grid.x_coordinates.begin(), grid.x_coordinates.end());
+  m_y_coordinates.assign(grid.y_coordinates.begin(), grid.y_coordinates.end());
+  m_forgetting = std::clamp(forgetting, 0.5, 1.0);
+  const float unknown = std::numeric_limits<float>::quiet_NaN();
+  m_cells.assign(grid.rows() * grid.cols(), LearnedCell{0.0f, unknown, unknown});
+
+  m_stop = false;
+  m_worker = std::thread(&SurfaceMapLearner::workerLoop, this);
+  return true;
+}
+
+void SurfaceMapLearner::stop()
+{
+  if (m_worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    m_worker.join();
+  }
+  m_x_coordinates.clear();
+  m_y_coordinates.clear();
+  m_observations.clear();
+  m_updates.clear();
+  m_estimates.clear();
+  m_pending.clear();
+  m_cells.clear();
+  m_learned_count = 0;
+  m_dropped = 0;
+}
+
+bool SurfaceMapLearner::matches(const SurfaceGrid & grid) const
+{
+  return isRunning() && grid.rows() == m_x_coordinates.size() &&
+         grid.cols() == m_y_coordinates.size() && grid.rows() > 0 && grid.cols() > 0 &&
+         grid.x_coordinates[0] == m_x_coordinates.front() &&
+         grid.x_coordinates[grid.rows() - 1] == m_x_coordinates.back() &&
+         grid.y_coordinates[0] == m_y_coordinates.front() &&
+         grid.y_coordinates[grid.cols() - 1] == m_y_coordinates.back();
+}
+
+void SurfaceMapLearner::observe(const ContactObservation & observation)
+{
+  if (!m_observations.push(observation))
+  {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void SurfaceMapLearner::applyUpdates()
+{
+  Update update;
+  for (size_t i = 0; i < kMaxUpdatesPerCycle && m_updates.pop(update); ++i)
+  {
+    LearnedCell & cell = m_cells[update.cell];
+    if (std::isnan(cell.stiffness))
+    {
+      m_learned_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    cell.height = update.height;
+    cell.stiffness = update.stiffness;
+    cell.damping = update.damping;
+  }
+}
+
+bool SurfaceMapLearner::correct(double x, double y, double & height, double & stiffness,
+                                double & damping)
+{
+  size_t index;
+  if (!cellIndex(x, y, m_x_hint, m_y_hint, index))
+  {
+    return false;
+  }
+  const LearnedCell & cell = m_cells[index];
+  if (std::isnan(cell.stiffness))
+  {
+    return false;
+  }
+  height = cell.height;
+  stiffness = cell.stiffness;
+  damping = cell.damping;
+  return true;
+}
+
+bool SurfaceMapLearner::cellIndex(double x, double y, size_t & x_hint, size_t & y_hint,
+                                  size_t & cell) const
+{
+  if (m_x_coordinates.empty() || m_y_coordinates.empty() ||
+      !(x >= m_x_coordinates.front() && x <= m_x_coordinates.back() &&
+        y >= m_y_coordinates.front() && y <= m_y_coordinates.back()))
+  {
+    return false;
+  }
+  x_hint = findClosestIndex(m_x_coordinates, x, x_hint);
+  y_hint = findClosestIndex(m_y_coordinates, y, y_hint);
+  cell = x_hint * m_y_coordinates.size() + y_hint;
+  return true;
+}
+
+void SurfaceMapLearner::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop_cv.wait_for(lock, kEstimatePeriod, [this] { return m_stop; }))
+  {
+    lock.unlock();
+
+    // Cells whose results did not fit into the queue last time go first
+    while (!m_pending.empty() && m_updates.push(result(m_pending.back())))
+    {
+      m_estimates[m_pending.back()].pending = false;
+      m_pending.pop_back();
+    }
+    ContactObservation observation;
+    while (m_observations.pop(observation))
+    {
+      update(observation);
+    }
+    lock.lock();
+  }
+}
+
+void SurfaceMapLearner::update(const ContactObservation & observation)
+{
+  size_t index;
+  if (!(observation.force > 0.0) || !std::isfinite(observation.force) ||
+      !cellIndex(observation.x, observation.y, m_worker_x_hint, m_worker_y_hint, index))
+  {
+    return;
+  }
+  const double n = observation.exponent;
+
+  // A new cell starts from the map, uncertain by about its own magnitude,
+  // and its height by kHeightUncertainty
+  auto inserted = m_estimates.try_emplace(index);
+  Estimate & estimate = inserted.first->second;
+  if (inserted.second)
+  {
+    const double stiffness = std::max(observation.stiffness, 1.0);
+    const double a = std::pow(stiffness, 1.0 / n);
+    estimate.theta[0] = a;
+    estimate.theta[1] = 0.0;
+    estimate.theta[2] = -a * observation.damping / (n * stiffness);
+    estimate.covariance_limit[0] = a * a;
+    estimate.covariance_limit[1] = a * kHeightUncertainty * a * kHeightUncertainty;
+    estimate.covariance_limit[2] = a * a / (n * stiffness) / (n * stiffness) *
+                                   std::max(observation.damping * observation.damping, 1.0);
+    for (int i = 0; i < kParameters; ++i)
+    {
+      for (int j = 0; j < kParameters; ++j)
+      {
+        estimate.covariance[i][j] = i == j ? estimate.covariance_limit[i] : 0.0;
+      }
+    }
+    estimate.pending = false;
+  }
+  estimate.exponent = n;
+  const double penetration = observation.penetration;
+  if (penetration + estimate.theta[1] / std::max(estimate.theta[0], kMinRoot) < kMinPenetration)
+  {
+    return;
+  }
+
+  // The n-th root of the contact model is linear in its parameters, up to
+  // terms in v * height:
+  // force^(1/n) = a * p + a * height + b * v * p,
+  // a = stiffness^(1/n), b = -a * damping / (n * stiffness).
+  // Each observation is weighted by the noise of the root.
+  const double root = std::pow(observation.force, 1.0 / n);
+  const double weight = n * observation.force / (root * kForceNoise);
+  const double phi[kParameters] = {weight * penetration, weight,
+                                   weight * observation.velocity * penetration};
+  double (&P)[kParameters][kParameters] = estimate.covariance;
+  double Pphi[kParameters];
+  double denominator = m_forgetting;
+  double prediction = 0.0;
+  for (int i = 0; i < kParameters; ++i)
+  {
+    Pphi[i] = 0.0;
+    for (int j = 0; j < kParameters; ++j)
+    {
+      Pphi[i] += P[i][j] * phi[j];
+    }
+    denominator += phi[i] * Pphi[i];
+    prediction += phi[i] * estimate.theta[i];
+  }
+  const double residual = weight * root - prediction;
+  double gain[kParameters];
+  for (int i = 0; i < kParameters; ++i)
+  {
+    gain[i] = Pphi[i] / denominator;
+    estimate.theta[i] += gain[i] * residual;
+  }
+  for (int i = 0; i < kParameters; ++i)
+  {
+    for (int j = i; j < kParameters; ++j)
+    {
+      P[i][j] = P[j][i] = (P[i][j] - gain[i] * Pphi[j]) / m_forgetting;
+    }
+  }
+
+  // Forgetting inflates the covariance of parameters that the observations
+  // do not excite, such as damping while the contact is static
+  for (int i = 0; i < kParameters; ++i)
+  {
+    if (P[i][i] > estimate.covariance_limit[i])
+    {
+      const double scale = std::sqrt(estimate.covariance_limit[i] / P[i][i]);
+      P[i][i] = estimate.covariance_limit[i];
+      for (int j = 0; j < kParameters; ++j)
+      {
+        if (j != i)
+        {
+          P[i][j] *= scale;
+          P[j][i] *= scale;
+        }
+      }
+    }
+  }
+
+  if (!estimate.pending && !m_updates.push(result(index)))
+  {
+    estimate.pending = true;
+    m_pending.push_back(index);
+  }
+}
+
+SurfaceMapLearner::Update SurfaceMapLearner::result(size_t cell) const
+{
+  const Estimate & estimate = m_estimates.at(cell);
+  const double n = estimate.exponent;
+  const double a = std::max(estimate.theta[0], kMinRoot);
+  const double stiffness = std::pow(a, n);
+  const double height = std::clamp(estimate.theta[1] / a, -kMaxHeightOffset, kMaxHeightOffset);
+  const double damping = std::max(-estimate.theta[2] * n * stiffness / a, 0.0);
+  return Update{cell, static_cast<float>(height), static_cast<float>(stiffness),
+                static_cast<float>(damping)};
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,228 @@
+#include <cartesian_adaptive_compliance_controller/surface_map_loader.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_shm.h>
+
+#include <chrono>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// How often a followed shared map is checked for a new generation
+constexpr auto kSharedPollPeriod = std::chrono::milliseconds(100);
+}  // namespace
+
+SurfaceMapLoader::SurfaceMapLoader()
+: m_current(nullptr),
+  m_reader_sequence(0),
+  m_quantize(false),
+  m_shared_generation(0),
+  m_load_pending(false),
+  m_stop(false)
+{
+  m_worker = std::thread(&SurfaceMapLoader::workerLoop, this);
+}
+
+SurfaceMapLoader::~SurfaceMapLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_request_cv.notify_all();
+  m_worker.join();
+
+  // The control loop is gone by now.
+  delete m_current.exchange(nullptr);
+}
+
+bool SurfaceMapLoader::loadNow(const std::string & directory, std::string & error)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shared_name.clear();
+  }
+  return load(directory, error);
+}
+
+bool SurfaceMapLoader::attachSharedNow(const std::string & name, std::string & error)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shared_name = name;
+    m_shared_generation = 0;
+  }
+  bool ok = attachShared(name, error);
+  m_request_cv.notify_one();
+  return ok;
+}
+
+void SurfaceMapLoader::requestLoad(const std::string & directory)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending_directory = directory;
+    m_shared_name.clear();
+    m_load_pending = true;
+  }
+  m_request_cv.notify_one();
+}
+
+void SurfaceMapLoader::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_shared_name.clear();
+  m_load_pending = false;
+  m_last_error.clear();
+  publish(nullptr);
+}
+
+std::string SurfaceMapLoader::lastError() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_last_error;
+}
+
+void SurfaceMapLoader::setErrorHandler(std::function<void(const std::string & error)> handler)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_error_handler = std::move(handler);
+}
+
+void SurfaceMapLoader::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    if (m_shared_name.empty())
+    {
+      m_request_cv.wait(lock, [this] { return m_stop || m_load_pending || !m_shared_name.empty(); });
+    }
+    else
+    {
+      m_request_cv.wait_for(lock, kSharedPollPeriod, [this] { return m_stop || m_load_pending; });
+    }
+    if (m_stop)
+    {
+      return;
+    }
+
+    std::string error;
+    const auto error_handler = m_error_handler;
+    if (m_load_pending)
+    {
+      std::string directory = m_pending_directory;
+      m_load_pending = false;
+      lock.unlock();
+      if (!load(directory, error))
+      {
+        error = directory + ": " + error;
+      }
+    }
+    else if (!m_shared_name.empty())
+    {
+      std::string name = m_shared_name;
+      uint64_t generation = m_shared_generation;
+      lock.unlock();
+      if (surface_map_shm::currentGeneration(name) != generation && !attachShared(name, error))
+      {
+        error = name + ": " + error;
+      }
+    }
+    else
+    {
+      continue;
+    }
+
+    // Nobody waits for a background load, so its failure is reported here
+    if (!error.empty() && error_handler)
+    {
+      error_handler(error);
+    }
+    lock.lock();
+  }
+}
+
+bool SurfaceMapLoader::load(const std::string & directory, std::string & error)
+{
+  auto map = std::make_unique<SurfaceMap>();
+  bool ok = loadSurfaceMap(directory, *map, error);
+  return finish(std::move(map), ok, false, error);
+}
+
+bool SurfaceMapLoader::attachShared(const std::string & name, std::string & error)
+{
+  auto map = std::make_unique<SurfaceMap>();
+  bool ok = surface_map_shm::attach(name, *map, error);
+  return finish(std::move(map), ok, true, error);
+}
+
+bool SurfaceMapLoader::finish(std::unique_ptr<SurfaceMap> map, bool ok, bool shared,
+                              std::string & error)
+{
+  if (ok)
+  {
+    quantize(*map);
+  }
+
+  // Synchronous loads and the loader thread publish one at a time
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (ok)
+  {
+    if (shared)
+    {
+      m_shared_generation = map->generation;
+    }
+    publish(std::move(map));
+    error.clear();
+  }
+  m_last_error = error;
+  return ok;
+}
+
+void SurfaceMapLoader::quantize(SurfaceMap & map) const
+{
+  if (!m_quantize)
+  {
+    return;
+  }
+  std::string report;
+  quantizeSurfaceMap(map, report);
+  map.load_report += report;
+}
+
+// Called with m_mutex held
+void SurfaceMapLoader::publish(std::unique_ptr<SurfaceMap> map)
+{
+  const SurfaceMap * old = m_current.exchange(map.release());
+  if (old == nullptr)
+  {
+    return;
+  }
+
+  // Grace period: if the reader was inside a read section when we swapped,
+  // it may still hold the old map. Wait until it leaves that section.
+  // Any later section is guaranteed to see the new pointer.
+  const uint64_t sequence = m_reader_sequence.load();
+  if (sequence & 1)
+  {
+    while (m_reader_sequence.load() == sequence)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  delete old;
+}
+
+SurfaceMapLoader::ReadGuard::ReadGuard(SurfaceMapLoader & loader) : m_loader(loader)
+{
+  m_loader.m_reader_sequence.fetch_add(1);
+  m_map = m_loader.m_current.load();
+}
+
+SurfaceMapLoader::ReadGuard::~ReadGuard()
+{
+  m_loader.m_reader_sequence.fetch_add(1);
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
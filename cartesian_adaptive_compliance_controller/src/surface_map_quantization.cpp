@@ -0,0 +1,188 @@
+#include <cartesian_adaptive_compliance_controller/signed_distance_field.h>
+#include <cartesian_adaptive_compliance_controller/surface_map.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+constexpr double kMaxCode = std::numeric_limits<uint16_t>::max();
+
+// Owned backing memory of one quantized field
+struct QuantizedBuffers
+{
+  std::vector<uint16_t> codes;
+  std::vector<QuantizationTile> tiles;
+};
+
+// Replaces the map's previous storage, so its double stiffness and damping
+// are freed together with it
+struct QuantizedStorage
+{
+  std::vector<std::vector<double>> values;
+  std::vector<float> distance_values;
+  std::vector<QuantizedBuffers> fields;
+};
+
+// Decoding errors of one field, accumulated over all levels
+struct QuantizationError
+{
+  size_t double_bytes = 0;
+  size_t quantized_bytes = 0;
+  double max_error = 0.0;
+  double squared_error = 0.0;
+  size_t count = 0;
+  double min_value = std::numeric_limits<double>::max();
+  double max_value = std::numeric_limits<double>::lowest();
+};
+
+// Moves a field that is kept as is into \a storage
+ArrayView<double> keep(ArrayView<double> values, QuantizedStorage & storage, size_t & bytes)
+{
+  bytes += values.size * sizeof(double);
+  storage.values.emplace_back(values.begin(), values.end());
+  return storage.values.back();
+}
+
+void quantizeField(const SurfaceGrid & grid, ArrayView<double> values, QuantizedBuffers & buffers,
+                   QuantizedField & field)
+{
+  const size_t n = grid.rows();
+  const size_t m = grid.cols();
+  const size_t tile = QuantizedField::kTileSize;
+  const size_t tile_rows = (n + tile - 1) / tile;
+  field.tile_cols = (m + tile - 1) / tile;
+
+  buffers.codes.resize(n * m);
+  buffers.tiles.resize(tile_rows * field.tile_cols);
+  for (size_t ti = 0; ti < tile_rows; ++ti)
+  {
+    const size_t i_end = std::min(n, (ti + 1) * tile);
+    for (size_t tj = 0; tj < field.tile_cols; ++tj)
+    {
+      const size_t j_end = std::min(m, (tj + 1) * tile);
+      double low = std::numeric_limits<double>::max();
+      double high = std::numeric_limits<double>::lowest();
+      for (size_t i = ti * tile; i < i_end; ++i)
+      {
+        for (size_t j = tj * tile; j < j_end; ++j)
+        {
+          low = std::min(low, values[grid.cellIndex(i, j)]);
+          high = std::max(high, values[grid.cellIndex(i, j)]);
+        }
+      }
+
+      QuantizationTile & parameters = buffers.tiles[ti * field.tile_cols + tj];
+      parameters.offset = low;
+      parameters.scale = (high - low) / kMaxCode;
+      for (size_t i = ti * tile; i < i_end; ++i)
+      {
+        for (size_t j = tj * tile; j < j_end; ++j)
+        {
+          const double code = parameters.scale > 0.0
+                                ? std::round((values[grid.cellIndex(i, j)] - low) / parameters.scale)
+                                : 0.0;
+          buffers.codes[grid.cellIndex(i, j)] = static_cast<uint16_t>(std::min(code, kMaxCode));
+        }
+      }
+    }
+  }
+  field.codes = buffers.codes;
+  field.tiles = buffers.tiles;
+}
+
+void measure(const SurfaceGrid & grid, ArrayView<double> values, const QuantizedField & field,
+             QuantizationError & error)
+{
+  error.double_bytes += values.size * sizeof(double);
+  error.quantized_bytes +=
+    field.codes.size * sizeof(uint16_t) + field.tiles.size * sizeof(QuantizationTile);
+  for (size_t i = 0; i < grid.rows(); ++i)
+  {
+    for (size_t j = 0; j < grid.cols(); ++j)
+    {
+      const double value = values[grid.cellIndex(i, j)];
+      const double difference = std::abs(field.decode(i, j, grid.cols()) - value);
+      error.max_error = std::max(error.max_error, difference);
+      error.squared_error += difference * difference;
+      error.min_value = std::min(error.min_value, value);
+      error.max_value = std::max(error.max_value, value);
+      ++error.count;
+    }
+  }
+}
+
+void print(std::ostream & report, const char * name, const QuantizationError & error)
+{
+  const double range = error.max_value - error.min_value;
+  report << name << ": " << std::fixed << std::setprecision(1)
+         << error.double_bytes / 1048576.0 << " MiB -> " << error.quantized_bytes / 1048576.0
+         << " MiB, " << std::scientific << std::setprecision(2) << "max error "
+         << error.max_error << ", rms error " << std::sqrt(error.squared_error / error.count)
+         << ", max error / range " << (range > 0.0 ? error.max_error / range : 0.0) << "\n";
+}
+}  // namespace
+
+void quantizeSurfaceMap(SurfaceMap & map, std::string & report)
+{
+  report.clear();
+  if (map.point_cloud || map.quantized() || map.hasMaterials())
+  {
+    // Material maps are smaller already
+    return;
+  }
+
+  // Everything else the map views is copied out of the previous storage,
+  // which is released at the end
+  auto storage = std::make_shared<QuantizedStorage>();
+  storage->values.reserve(5 * map.levelCount());
+  storage->fields.resize(2 * map.levelCount());
+
+  QuantizationError stiffness_error;
+  QuantizationError damping_error;
+  size_t kept_bytes = 0;
+  for (size_t l = 0; l < map.levelCount(); ++l)
+  {
+    SurfaceGrid & grid = l == 0 ? static_cast<SurfaceGrid &>(map) : map.levels[l - 1];
+    quantizeField(grid, grid.stiffness_values, storage->fields[2 * l], grid.stiffness_quantized);
+    quantizeField(grid, grid.damping_values, storage->fields[2 * l + 1], grid.damping_quantized);
+    measure(grid, grid.stiffness_values, grid.stiffness_quantized, stiffness_error);
+    measure(grid, grid.damping_values, grid.damping_quantized, damping_error);
+    grid.stiffness_values = ArrayView<double>();
+    grid.damping_values = ArrayView<double>();
+
+    grid.x_coordinates = keep(grid.x_coordinates, *storage, kept_bytes);
+    grid.y_coordinates = keep(grid.y_coordinates, *storage, kept_bytes);
+    grid.z_values = keep(grid.z_values, *storage, kept_bytes);
+    grid.dz_dx_values = keep(grid.dz_dx_values, *storage, kept_bytes);
+    grid.dz_dy_values = keep(grid.dz_dy_values, *storage, kept_bytes);
+  }
+  if (map.distance_field)
+  {
+    auto distance_field = std::make_shared<SignedDistanceField>(*map.distance_field);
+    storage->distance_values.assign(distance_field->values.begin(),
+                                    distance_field->values.end());
+    distance_field->values = storage->distance_values;
+    map.distance_field = distance_field;
+  }
+  map.storage = storage;
+
+  const size_t double_bytes =
+    kept_bytes + stiffness_error.double_bytes + damping_error.double_bytes;
+  const size_t quantized_bytes =
+    kept_bytes + stiffness_error.quantized_bytes + damping_error.quantized_bytes;
+  std::ostringstream stream;
+  print(stream, "quantized stiffness", stiffness_error);
+  print(stream, "quantized damping", damping_error);
+  stream << "quantized map: " << std::fixed << std::setprecision(1) << double_bytes / 1048576.0
+         << " MiB -> " << quantized_bytes / 1048576.0 << " MiB\n";
+  report = stream.str();
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,348 @@
+#include <cartesian_adaptive_compliance_controller/surface_map_sequence.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+namespace
+{
+// How often the streaming thread checks where the reader is
+constexpr auto kStreamPeriod = std::chrono::milliseconds(2);
+
+constexpr const char * kSequenceName = "sequence.txt";
+}  // namespace
+
+bool sampleSurface(const SurfaceFrames & frames, double x, double y, double travel,
+                   SurfaceCursor & cursor, SurfaceSample & sample)
+{
+  if (!sampleSurface(*frames.current, x, y, travel, cursor, sample))
+  {
+    return false;
+  }
+  if (frames.next == nullptr)
+  {
+    return true;
+  }
+
+  // Frames of one sequence usually share their grid, so the hint carries over
+  SurfaceCursor next_cursor = cursor;
+  next_cursor.map = frames.next;
+  SurfaceSample next;
+  if (!sampleSurface(*frames.next, x, y, travel, next_cursor, next))
+  {
+    return true;
+  }
+
+  const double w = frames.weight;
+  sample.dz_dt = (next.z - sample.z) / frames.interval;
+  sample.z += w * (next.z - sample.z);
+  sample.stiffness += w * (next.stiffness - sample.stiffness);
+  sample.damping += w * (next.damping - sample.damping);
+  sample.dz_dx += w * (next.dz_dx - sample.dz_dx);
+  sample.dz_dy += w * (next.dz_dy - sample.dz_dy);
+  return true;
+}
+
+SurfaceMapSequence::SurfaceMapSequence()
+: m_loop(false), m_reader_sequence(0), m_time(0.0), m_stop(false)
+{
+}
+
+SurfaceMapSequence::~SurfaceMapSequence()
+{
+  close();
+}
+
+bool SurfaceMapSequence::open(const std::string & path, bool loop, std::string & error)
+{
+  close();
+
+  struct stat info;
+  const bool is_directory = stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+  const std::string filename = is_directory ? path + "/" + kSequenceName : path;
+  const std::string directory =
+    is_directory ? path : filename.substr(0, filename.find_last_of('/') + 1);
+
+  std::ifstream file(filename);
+  if (!file.is_open())
+  {
+    error = "Cannot open " + filename;
+    return false;
+  }
+  std::vector<Frame> frames;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number)
+  {
+    std::istringstream fields(line);
+    Frame frame;
+    if (line.empty() || line[0] == '#' || !(fields >> frame.time))
+    {
+      continue;
+    }
+    if (!(fields >> frame.path) || !std::isfinite(frame.time) ||
+        (!frames.empty() && frame.time <= frames.back().time))
+    {
+      error = filename + ":" + std::to_string(number) +
+              ": expected '<time> <map>' with strictly ascending times";
+      return false;
+    }
+    if (frame.path[0] != '/')
+    {
+      frame.path = directory + (directory.empty() || directory.back() == '/' ? "" : "/") +
+                   frame.path;
+    }
+    frames.push_back(frame);
+  }
+  if (frames.empty())
+  {
+    error = filename + " lists no frames";
+    return false;
+  }
+
+  m_frames = std::move(frames);
+  m_loop = loop && m_frames.size() > 1;
+  m_failed_frames.assign(m_frames.size(), 0);
+  m_time = m_frames.front().time;
+  for (size_t i = 0; i < std::min(kFrameSlots, m_frames.size()); ++i)
+  {
+    if (!fill(m_slots[i], i))
+    {
+      error = lastError();
+      close();
+      return false;
+    }
+  }
+
+  m_stop = false;
+  m_worker = std::thread(&SurfaceMapSequence::workerLoop, this);
+  return true;
+}
+
+void SurfaceMapSequence::close()
+{
+  if (m_worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    m_worker.join();
+  }
+  for (Slot & slot : m_slots)
+  {
+    slot.ready = false;
+    slot.map.reset();
+  }
+  m_frames.clear();
+  m_failed_frames.clear();
+}
+
+std::string SurfaceMapSequence::lastError() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_last_error;
+}
+
+double SurfaceMapSequence::wrap(double time) const
+{
+  const double first = m_frames.front().time;
+  const double last = m_frames.back().time;
+  if (m_loop)
+  {
+    const double offset = std::fmod(time - first, last - first);
+    return first + (offset < 0.0 ? offset + (last - first) : offset);
+  }
+  return std::clamp(time, first, last);
+}
+
+size_t SurfaceMapSequence::frameAt(double time) const
+{
+  auto after = std::upper_bound(m_frames.begin(), m_frames.end(), time,
+                                [](double t, const Frame & frame) { return t < frame.time; });
+  return after == m_frames.begin() ? 0 : (after - m_frames.begin()) - 1;
+}
+
+size_t SurfaceMapSequence::successor(size_t frame) const
+{
+  if (frame + 1 < m_frames.size())
+  {
+    return frame + 1;
+  }
+  return m_loop ? 0 : frame;
+}
+
+void SurfaceMapSequence::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop_cv.wait_for(lock, kStreamPeriod, [this] { return m_stop; }))
+  {
+    lock.unlock();
+
+    // The frames from the reader's one onwards, nearest first
+    size_t wanted[kFrameSlots];
+    size_t wanted_count = 0;
+    size_t frame = frameAt(wrap(m_time.load()));
+    for (size_t i = 0; i < std::min(kFrameSlots, m_frames.size()); ++i)
+    {
+      wanted[wanted_count++] = frame;
+      if (successor(frame) == frame)
+      {
+        break;
+      }
+      frame = successor(frame);
+    }
+    auto is_wanted = [&](size_t f) {
+      return std::find(wanted, wanted + wanted_count, f) != wanted + wanted_count;
+    };
+
+    for (size_t i = 0; i < wanted_count; ++i)
+    {
+      const size_t f = wanted[i];
+      auto has_frame = [f](const Slot & slot) { return slot.ready && slot.frame == f; };
+      if (failed(f) || std::any_of(m_slots, m_slots + kFrameSlots, has_frame))
+      {
+        continue;
+      }
+      auto is_free = [&](const Slot & slot) { return !slot.ready || !is_wanted(slot.frame); };
+      Slot * victim = std::find_if(m_slots, m_slots + kFrameSlots, is_free);
+      if (victim == m_slots + kFrameSlots)
+      {
+        break;
+      }
+      fill(*victim, f);
+
+      // The reader may have moved on meanwhile
+      break;
+    }
+    lock.lock();
+  }
+}
+
+bool SurfaceMapSequence::failed(size_t frame) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_failed_frames[frame] != 0;
+}
+
+bool SurfaceMapSequence::fill(Slot & slot, size_t frame)
+{
+  // The slot keeps its frame if the new one fails to load
+  auto map = std::make_unique<SurfaceMap>();
+  std::string error;
+  if (!loadSurfaceMap(m_frames[frame].path, *map, error))
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failed_frames[frame] = 1;
+    m_last_error = "Frame at " + std::to_string(m_frames[frame].time) + " s: " + error;
+    return false;
+  }
+  evict(slot);
+  slot.map = std::move(map);
+  slot.frame.store(frame, std::memory_order_relaxed);
+  slot.ready.store(true, std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_last_error.clear();
+  return true;
+}
+
+void SurfaceMapSequence::evict(Slot & slot)
+{
+  if (!slot.ready)
+  {
+    return;
+  }
+  slot.ready = false;
+
+  // Grace period as in SurfaceMapLoader::publish(). A read section that
+  // started after the flag was cleared does not pick this slot.
+  const uint64_t sequence = m_reader_sequence.load();
+  if (sequence & 1)
+  {
+    while (m_reader_sequence.load() == sequence)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  slot.map.reset();
+}
+
+SurfaceMapSequence::ReadGuard::ReadGuard(SurfaceMapSequence & sequence, double time)
+: m_sequence(sequence)
+{
+  m_sequence.m_reader_sequence.fetch_add(1);
+  if (!m_sequence.isOpen())
+  {
+    return;
+  }
+  const double t = m_sequence.wrap(time);
+  m_sequence.m_time.store(t);
+
+  // The latest loaded frame that is not ahead of t. If there is none, the
+  // earliest loaded one is held until the stream catches up.
+  const Slot * current = nullptr;
+  const Slot * earliest = nullptr;
+  for (const Slot & slot : m_sequence.m_slots)
+  {
+    if (!slot.ready.load(std::memory_order_acquire))
+    {
+      continue;
+    }
+    const double frame_time = m_sequence.m_frames[slot.frame].time;
+    if (frame_time <= t && (!current || frame_time > m_sequence.m_frames[current->frame].time))
+    {
+      current = &slot;
+    }
+    if (!earliest || frame_time < m_sequence.m_frames[earliest->frame].time)
+    {
+      earliest = &slot;
+    }
+  }
+  if (current == nullptr)
+  {
+    current = earliest;
+  }
+  if (current == nullptr)
+  {
+    return;
+  }
+  m_frames.current = current->map.get();
+
+  const size_t next_frame = m_sequence.successor(current->frame);
+  if (next_frame == current->frame)
+  {
+    return;
+  }
+  for (const Slot & slot : m_sequence.m_slots)
+  {
+    if (slot.ready.load(std::memory_order_acquire) && slot.frame == next_frame)
+    {
+      const double start = m_sequence.m_frames[current->frame].time;
+      double end = m_sequence.m_frames[next_frame].time;
+      if (end <= start)
+      {
+        // Wrapping around from the last frame, which equals the first, to the second
+        end += m_sequence.m_frames.back().time - m_sequence.m_frames.front().time;
+      }
+      m_frames.next = slot.map.get();
+      m_frames.interval = end - start;
+      m_frames.weight = std::clamp((t - start) / m_frames.interval, 0.0, 1.0);
+      break;
+    }
+  }
+}
+
+SurfaceMapSequence::ReadGuard::~ReadGuard()
+{
+  m_sequence.m_reader_sequence.fetch_add(1);
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,51 @@
+// Loads a surface map once and publishes it to all controllers on this host.
+//
+// Usage: surface_map_server <map_directory> [shm_name]
+//        surface_map_server --unlink [shm_name]
+//
+// Running it again with a new directory publishes the next generation.
+// Controllers with a matching `surface_map_shared_memory` parameter pick it up
+// without being reconfigured.
+
+#include <cartesian_adaptive_compliance_controller/surface_map_shm.h>
+
+#include <iostream>
+#include <string>
+
+using namespace cartesian_adaptive_compliance_controller;
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <map_directory> [shm_name]" << std::endl;
+    std::cerr << "       " << argv[0] << " --unlink [shm_name]" << std::endl;
+    return 1;
+  }
+  const std::string name = argc > 2 ? argv[2] : "adaptive_surface_map";
+
+  if (std::string(argv[1]) == "--unlink")
+  {
+    surface_map_shm::unlink(name);
+    return 0;
+  }
+
+  SurfaceMap map;
+  std::string error;
+  if (!loadSurfaceMap(argv[1], map, error))
+  {
+    std::cerr << "Failed to load surface map: " << error << std::endl;
+    return 1;
+  }
+  std::cout << map.load_report;
+
+  uint64_t generation = 0;
+  if (!surface_map_shm::publish(name, map, generation, error))
+  {
+    std::cerr << "Failed to publish surface map: " << error << std::endl;
+    return 1;
+  }
+  std::cout << "Published " << map.rows() << " x " << map.cols() << " map from " << argv[1]
+            << " as /" << name << " generation " << generation << std::endl;
+  return 0;
+}
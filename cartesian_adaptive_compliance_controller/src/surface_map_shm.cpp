@@ -0,0 +1,229 @@
+#include <cartesian_adaptive_compliance_controller/surface_map_image.h>
+#include <cartesian_adaptive_compliance_controller/surface_map_shm.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace cartesian_adaptive_compliance_controller
+{
+namespace surface_map_shm
+{
+
+namespace
+{
+constexpr uint32_t kControlMagic = 0x4c525443;  // "CTRL"
+
+// Contents of the /<name> segment
+struct Control
+{
+  uint32_t magic;
+  uint32_t reserved;
+
+  // Published generation, and the last one handed out to a publisher
+  std::atomic<uint64_t> generation;
+  std::atomic<uint64_t> allocated;
+};
+
+std::string controlName(const std::string & name)
+{
+  return "/" + name;
+}
+
+std::string segmentName(const std::string & name, uint64_t generation)
+{
+  return "/" + name + "." + std::to_string(generation);
+}
+
+std::string systemError(const std::string & what)
+{
+  return what + ": " + std::strerror(errno);
+}
+
+// Maps the control segment. Creates it if \a create is set.
+Control * openControl(const std::string & name, bool create)
+{
+  int fd = shm_open(controlName(name).c_str(), create ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  if (create && ftruncate(fd, sizeof(Control)) != 0)
+  {
+    close(fd);
+    return nullptr;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Control))
+  {
+    close(fd);
+    return nullptr;
+  }
+  void * memory =
+    mmap(nullptr, sizeof(Control), create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    return nullptr;
+  }
+  return static_cast<Control *>(memory);
+}
+
+void closeControl(Control * control)
+{
+  munmap(control, sizeof(Control));
+}
+}  // namespace
+
+bool publish(const std::string & name, const SurfaceMap & map, uint64_t & generation,
+             std::string & error)
+{
+  if (map.point_cloud)
+  {
+    error = "Point cloud maps cannot be shared";
+    return false;
+  }
+  if (map.quantized())
+  {
+    error = "Quantized maps cannot be shared, quantize after attaching instead";
+    return false;
+  }
+  Control * control = openControl(name, true);
+  if (control == nullptr)
+  {
+    error = systemError("Cannot open control segment " + controlName(name));
+    return false;
+  }
+  // A freshly created segment is zero-filled. Concurrent publishers each
+  // get a generation of their own, beyond the published one also for
+  // segments that predate the allocation counter.
+  control->magic = kControlMagic;
+  uint64_t allocated = control->allocated.load();
+  do
+  {
+    generation = std::max(allocated, control->generation.load()) + 1;
+  } while (!control->allocated.compare_exchange_weak(allocated, generation));
+
+  const std::string segment = segmentName(name, generation);
+  int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0444);
+  if (fd < 0)
+  {
+    error = systemError("Cannot create " + segment);
+    closeControl(control);
+    return false;
+  }
+  const size_t size = surfaceMapImageSize(map);
+  if (ftruncate(fd, size) != 0)
+  {
+    error = systemError("Cannot resize " + segment);
+    close(fd);
+    shm_unlink(segment.c_str());
+    closeControl(control);
+    return false;
+  }
+  void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    error = systemError("Cannot map " + segment);
+    shm_unlink(segment.c_str());
+    closeControl(control);
+    return false;
+  }
+  writeSurfaceMapImage(map, generation, memory);
+  munmap(memory, size);
+
+  // Readers switch over from here on. The counter only moves forward, so a
+  // publisher that was overtaken by a later generation withdraws its own.
+  uint64_t previous = control->generation.load();
+  while (previous < generation && !control->generation.compare_exchange_weak(previous, generation))
+  {
+  }
+  closeControl(control);
+
+  if (previous > generation)
+  {
+    shm_unlink(segment.c_str());
+  }
+  else if (previous > 0)
+  {
+    shm_unlink(segmentName(name, previous).c_str());
+  }
+  return true;
+}
+
+void unlink(const std::string & name)
+{
+  const uint64_t generation = currentGeneration(name);
+  if (generation > 0)
+  {
+    shm_unlink(segmentName(name, generation).c_str());
+  }
+  shm_unlink(controlName(name).c_str());
+}
+
+uint64_t currentGeneration(const std::string & name)
+{
+  Control * control = openControl(name, false);
+  if (control == nullptr)
+  {
+    return 0;
+  }
+  uint64_t generation = control->magic == kControlMagic ? control->generation.load() : 0;
+  closeControl(control);
+  return generation;
+}
+
+bool attach(const std::string & name, SurfaceMap & map, std::string & error)
+{
+  const uint64_t generation = currentGeneration(name);
+  if (generation == 0)
+  {
+    error = "No surface map is published as " + controlName(name);
+    return false;
+  }
+
+  // The publisher may have moved on and unlinked this generation already.
+  // The caller simply tries again with the next one.
+  const std::string segment = segmentName(name, generation);
+  int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    error = systemError("Cannot open " + segment);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    error = systemError("Cannot stat " + segment);
+    close(fd);
+    return false;
+  }
+  const size_t size = info.st_size;
+  void * memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    error = systemError("Cannot map " + segment);
+    return false;
+  }
+
+  std::shared_ptr<const void> mapping(memory, [size](const void * p) {
+    munmap(const_cast<void *>(p), size);
+  });
+  if (!viewSurfaceMapImage(memory, size, mapping, map, error))
+  {
+    return false;
+  }
+  map.source = "shm:" + name;
+  return true;
+}
+
+}  // namespace surface_map_shm
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,44 @@
+#include <cartesian_adaptive_compliance_controller/telemetry.h>
+
+#include <limits>
+#include <sstream>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+void writeTelemetryCsvHeader(std::ostream & out)
+{
+  out << "time";
+  for (const char * name : kTelemetryFieldNames)
+  {
+    out << ',' << name;
+  }
+  out << '\n';
+}
+
+void writeTelemetryCsvRow(std::ostream & out, const TelemetrySample & sample)
+{
+  const auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+  out << sample.time;
+#define TELEMETRY_CSV(name, member, unit, decimation) out << ',' << sample.name;
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_CSV)
+#undef TELEMETRY_CSV
+  out << '\n';
+  out.precision(precision);
+}
+
+std::string telemetryJsonSchema()
+{
+  std::ostringstream schema;
+  schema << "{\"title\":\"AdaptiveStiffnessTelemetry\",\"type\":\"object\",\"properties\":{"
+         << "\"time\":{\"type\":\"number\",\"description\":\"s\"}";
+  for (size_t i = 0; i < TelemetryField::count; ++i)
+  {
+    schema << ",\"" << kTelemetryFieldNames[i] << "\":{\"type\":\"number\",\"description\":\""
+           << kTelemetryFieldUnits[i] << "\"}";
+  }
+  schema << "}}";
+  return schema.str();
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
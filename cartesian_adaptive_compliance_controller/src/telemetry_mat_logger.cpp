@@ -0,0 +1,81 @@
+#include <cartesian_adaptive_compliance_controller/telemetry_mat_logger.h>
+
+#include <exception>
+#include <iterator>
+
+namespace cartesian_adaptive_compliance_controller
+{
+
+TelemetryMatLogger::~TelemetryMatLogger()
+{
+  stop();
+}
+
+bool TelemetryMatLogger::start(const std::string & path, int buffer_size, std::string & error)
+{
+  stop();
+  if (buffer_size <= 0)
+  {
+    error = "buffer size must be positive";
+    return false;
+  }
+
+  m_dropped.store(0, std::memory_order_relaxed);
+  m_names.assign(1, "time");
+  m_names.insert(m_names.end(), std::begin(kTelemetryFieldNames), std::end(kTelemetryFieldNames));
+  try
+  {
+    m_logger = XBot::MatLogger2::MakeLogger(path);
+    m_logger->set_buffer_mode(XBot::VariableBuffer::Mode::producer_consumer);
+    for (const std::string & name : m_names)
+    {
+      if (!m_logger->create(name, 1, 1, buffer_size))
+      {
+        error = "cannot create variable " + name;
+        m_logger.reset();
+        return false;
+      }
+    }
+    m_appender = XBot::MatAppender::MakeInstance();
+    m_appender->add_logger(m_logger);
+    m_appender->start_flush_thread();
+  }
+  catch (const std::exception & exception)
+  {
+    error = exception.what();
+    m_appender.reset();
+    m_logger.reset();
+    return false;
+  }
+  return true;
+}
+
+void TelemetryMatLogger::stop()
+{
+  // The appender flushes the remaining samples when it goes
+  m_appender.reset();
+  m_logger.reset();
+}
+
+void TelemetryMatLogger::log(const TelemetrySample & sample)
+{
+  // All variables fill at the same rate, so a full buffer drops the sample
+  size_t i = 0;
+  bool added = m_logger->add(m_names[i++], sample.time);
+#define TELEMETRY_MAT(name, member, unit, decimation) \
+  added = m_logger->add(m_names[i++], sample.name) && added;
+  ADAPTIVE_STIFFNESS_TELEMETRY(TELEMETRY_MAT)
+#undef TELEMETRY_MAT
+  if (!added)
+  {
+    // Single writer
+    m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+}
+
+std::string TelemetryMatLogger::filename() const
+{
+  return m_logger ? m_logger->get_filename() : std::string();
+}
+
+}  // namespace cartesian_adaptive_compliance_controller
@@ -0,0 +1,4 @@
+// The probes of the tracepoint provider are instantiated once, here
+#define TRACEPOINT_CREATE_PROBES
+#define TRACEPOINT_DEFINE
+#include <cartesian_adaptive_compliance_controller/tracepoints.h>